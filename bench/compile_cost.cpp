@@ -0,0 +1,351 @@
+// Downstream compile-cost benchmark
+//
+// Runs dir2src over generated reference corpora and compiles every output
+// source file with the host compiler, recording compile wall time and peak
+// compiler memory per output format and input file size.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#define NOMINMAX
+#include <Windows.h>
+
+struct ProcessResult {
+    bool launched = false;
+    DWORD exit_code = 0;
+    double wall_seconds = 0.0;
+
+    // Committed by the process and every process it started, together
+    size_t peak_memory = 0;
+};
+
+ProcessResult RunProcess(std::string command_line) {
+    ProcessResult result;
+
+    STARTUPINFO startup_info = {};
+    startup_info.cb = sizeof(startup_info);
+
+    PROCESS_INFORMATION process_info = {};
+
+    // Compiler drivers like g++ and clang++ run the compiler proper as a
+    // child process, so memory is measured over a job holding both. Children
+    // inherit the job; any left behind are killed when it's closed.
+    HANDLE job = ::CreateJobObject(NULL, NULL);
+    if (job == NULL) {
+        fprintf(stderr, "Failed to create job object: %lu\n", GetLastError());
+        return result;
+    }
+
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limit_info = {};
+    limit_info.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    ::SetInformationJobObject(job, JobObjectExtendedLimitInformation, &limit_info, sizeof(limit_info));
+
+    LARGE_INTEGER frequency, start, end;
+    ::QueryPerformanceFrequency(&frequency);
+    ::QueryPerformanceCounter(&start);
+
+    // Suspended until it's in the job, so it can't start a child outside it
+    BOOL created = ::CreateProcess(
+        NULL,                                // lpApplicationName
+        command_line.data(),                 // lpCommandLine
+        NULL,                                // lpProcessAttributes
+        NULL,                                // lpThreadAttributes
+        FALSE,                               // bInheritHandles
+        CREATE_NO_WINDOW | CREATE_SUSPENDED, // dwCreationFlags
+        NULL,                                // lpEnvironment
+        NULL,                                // lpCurrentDirectory
+        &startup_info,                       // lpStartupInfo
+        &process_info                        // lpProcessInformation
+    );
+
+    if (!created) {
+        fprintf(stderr, "Failed to launch \"%s\": %lu\n", command_line.c_str(), GetLastError());
+        CloseHandle(job);
+        return result;
+    }
+
+    if (!::AssignProcessToJobObject(job, process_info.hProcess)) {
+        fprintf(stderr, "Failed to assign \"%s\" to a job object: %lu\n", command_line.c_str(), GetLastError());
+        ::TerminateProcess(process_info.hProcess, 1);
+        CloseHandle(process_info.hThread);
+        CloseHandle(process_info.hProcess);
+        CloseHandle(job);
+        return result;
+    }
+
+    ::ResumeThread(process_info.hThread);
+
+    // The driver waits for the compiler, so it exits last
+    ::WaitForSingleObject(process_info.hProcess, INFINITE);
+    ::QueryPerformanceCounter(&end);
+
+    result.launched = true;
+    result.wall_seconds = (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+
+    ::GetExitCodeProcess(process_info.hProcess, &result.exit_code);
+
+    if (::QueryInformationJobObject(job, JobObjectExtendedLimitInformation, &limit_info, sizeof(limit_info), NULL)) {
+        result.peak_memory = limit_info.PeakJobMemoryUsed;
+    }
+
+    CloseHandle(process_info.hThread);
+    CloseHandle(process_info.hProcess);
+    CloseHandle(job);
+
+    return result;
+}
+
+bool WriteFile(const std::string& file_path, const std::vector<uint8_t>& contents) {
+    HANDLE h_output_file = ::CreateFile(
+        file_path.c_str(),     // lpFileName
+        GENERIC_WRITE,         // dwDesiredAccess
+        0,                     // dwShareMode
+        NULL,                  // lpSecurityAttributes
+        CREATE_ALWAYS,         // dwCreeationDisposition
+        FILE_ATTRIBUTE_NORMAL, // dwFlagsAndAttributes
+        NULL                   // hTemplateFile
+    );
+
+    if (h_output_file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to create corpus file: %lu\n", GetLastError());
+        return false;
+    }
+
+    DWORD number_of_bytes_written;
+    BOOL write_success = ::WriteFile(h_output_file, contents.data(), (DWORD)contents.size(), &number_of_bytes_written, NULL);
+
+    CloseHandle(h_output_file);
+
+    if (!write_success) {
+        fprintf(stderr, "Failed to write corpus file: %lu\n", GetLastError());
+        return false;
+    }
+
+    return true;
+}
+
+size_t FileSize(const std::string& file_path) {
+    WIN32_FIND_DATA find_data = {};
+    HANDLE h_find_file = ::FindFirstFile(file_path.c_str(), &find_data);
+
+    if (h_find_file == INVALID_HANDLE_VALUE) return 0;
+
+    ::FindClose(h_find_file);
+    return ((size_t)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow;
+}
+
+std::string FindCompiler() {
+    char buffer[MAX_PATH];
+
+    DWORD cxx_length = ::GetEnvironmentVariable("CXX", buffer, MAX_PATH);
+    if (cxx_length > 0 && cxx_length < MAX_PATH) {
+        return buffer;
+    }
+
+    for (const char* candidate : { "clang++.exe", "g++.exe", "cl.exe" }) {
+        if (::SearchPath(NULL, candidate, NULL, MAX_PATH, buffer, NULL) > 0) {
+            return buffer;
+        }
+    }
+
+    return {};
+}
+
+bool IsMsvcCompiler(const std::string& compiler) {
+    size_t name_idx = compiler.find_last_of("\\/");
+    std::string name = compiler.substr(name_idx == std::string::npos ? 0 : name_idx + 1);
+
+    for (auto& c : name) c = (char)std::tolower(c);
+
+    return name == "cl" || name == "cl.exe" || name == "clang-cl" || name == "clang-cl.exe";
+}
+
+// Mix of text-like and binary content, so formats that special-case printable
+// bytes are measured fairly. Deterministic so runs are comparable.
+std::vector<uint8_t> GenerateCorpusFile(size_t size, uint32_t seed) {
+    std::vector<uint8_t> data(size);
+
+    uint32_t state = seed * 2654435761u + 1;
+    for (size_t i = 0; i < size; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+
+        data[i] = (i / 4096) % 2 == 0
+            ? (uint8_t)(' ' + state % 95)
+            : (uint8_t)state;
+    }
+
+    return data;
+}
+
+struct BenchmarkRow {
+    std::string format;
+    size_t file_size = 0;
+    size_t file_count = 0;
+    size_t output_bytes = 0;
+    double generate_seconds = 0.0;
+    double compile_seconds = 0.0;
+    size_t peak_compiler_memory = 0;
+    size_t failed_compiles = 0;
+};
+
+void PrintHelp() {
+    printf(R"(
+Usage:
+
+    dir2src_compile_cost [OPTIONS] <dir2src-path> <work-path>
+
+Options:
+
+    --compiler <path>           host compiler [default: %%CXX%%, clang++, g++ or cl]
+    --format <name>             dir2src output format to measure, repeatable
+                                [default: "array" and "hex"]
+    --size <bytes>              corpus file size to measure, repeatable
+                                [default: 1K, 16K, 256K, 4M]
+    --files <count>             files per corpus [default: "8"]
+
+)");
+}
+
+int main(int argc, const char* argv[]) {
+
+    if (argc < 3) {
+        PrintHelp();
+        return 0;
+    }
+
+    std::string compiler;
+    std::vector<std::string> formats;
+    std::vector<size_t> sizes;
+    size_t files_per_corpus = 8;
+
+    for (int i = 1; i < argc - 2; ++i) {
+        std::string arg = argv[i];
+
+        if (i + 1 >= argc - 2) {
+            fprintf(stderr, "Missing value for option %s\n", arg.c_str());
+            return 1;
+        }
+
+        std::string val = argv[++i];
+
+        if (arg == "--compiler") compiler = val;
+        else if (arg == "--format") formats.push_back(val);
+        else if (arg == "--size") sizes.push_back(std::stoull(val));
+        else if (arg == "--files") files_per_corpus = std::stoull(val);
+        else {
+            fprintf(stderr, "Unknown option \"%s\"\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if (formats.empty()) formats = { "array", "hex" };
+    if (sizes.empty()) sizes = { 1 << 10, 16 << 10, 256 << 10, 4 << 20 };
+
+    if (compiler.empty()) compiler = FindCompiler();
+    if (compiler.empty()) {
+        fprintf(stderr, "No host compiler found; pass --compiler or set CXX\n");
+        return 1;
+    }
+
+    const bool msvc = IsMsvcCompiler(compiler);
+
+    std::string dir2src_path = argv[argc - 2];
+    std::string work_path = argv[argc - 1];
+    if (work_path.back() != '\\' && work_path.back() != '/') work_path.push_back('\\');
+
+    ::CreateDirectory(work_path.c_str(), NULL);
+
+    std::vector<BenchmarkRow> rows;
+
+    for (size_t size : sizes) {
+
+        // Corpus is shared by all formats of the same size
+        std::string corpus_path = work_path + "corpus_" + std::to_string(size) + "\\";
+        ::CreateDirectory(corpus_path.c_str(), NULL);
+
+        std::vector<std::string> file_names;
+        for (size_t i = 0; i < files_per_corpus; ++i) {
+            file_names.push_back("file_" + std::to_string(i) + ".bin");
+            WriteFile(corpus_path + file_names.back(), GenerateCorpusFile(size, (uint32_t)i));
+        }
+
+        for (const auto& format : formats) {
+            BenchmarkRow row;
+            row.format = format;
+            row.file_size = size;
+            row.file_count = files_per_corpus;
+
+            std::string output_path = work_path + "out_" + std::to_string(size) + "_" + format + "\\";
+
+            ProcessResult generate = RunProcess(
+                "\"" + dir2src_path + "\" --format " + format + " \"" + corpus_path + "\" \"" + output_path + "\"");
+
+            if (!generate.launched || generate.exit_code != 0) {
+                fprintf(stderr, "dir2src failed for format \"%s\", size %zu\n", format.c_str(), size);
+                continue;
+            }
+
+            row.generate_seconds = generate.wall_seconds;
+
+            for (const auto& file_name : file_names) {
+                std::string source_path = output_path + file_name + ".cpp";
+                std::string object_path = output_path + file_name + ".obj";
+
+                row.output_bytes += FileSize(source_path);
+
+                std::string command_line = msvc
+                    ? "\"" + compiler + "\" /nologo /c /std:c++20 \"" + source_path + "\" /Fo\"" + object_path + "\""
+                    : "\"" + compiler + "\" -c -std=c++20 \"" + source_path + "\" -o \"" + object_path + "\"";
+
+                ProcessResult compile = RunProcess(command_line);
+
+                if (!compile.launched || compile.exit_code != 0) {
+                    ++row.failed_compiles;
+                }
+
+                row.compile_seconds += compile.wall_seconds;
+                row.peak_compiler_memory = std::max(row.peak_compiler_memory, compile.peak_memory);
+            }
+
+            rows.push_back(row);
+        }
+    }
+
+    std::stringstream ss;
+    ss << "Compiler: " << compiler << "\n\n";
+    ss << "| format | file size | files | output bytes | bytes out/in | generate (s) | compile (s) | compile/file (s) | peak compiler memory (MiB) | failed |\n";
+    ss << "|---|---:|---:|---:|---:|---:|---:|---:|---:|---:|\n";
+
+    for (const auto& row : rows) {
+        double input_bytes = (double)row.file_size * (double)row.file_count;
+
+        char line[512];
+        snprintf(line, sizeof(line), "| %s | %zu | %zu | %zu | %.2f | %.3f | %.3f | %.3f | %.1f | %zu |\n",
+            row.format.c_str(),
+            row.file_size,
+            row.file_count,
+            row.output_bytes,
+            input_bytes > 0 ? (double)row.output_bytes / input_bytes : 0.0,
+            row.generate_seconds,
+            row.compile_seconds,
+            row.file_count > 0 ? row.compile_seconds / (double)row.file_count : 0.0,
+            (double)row.peak_compiler_memory / (1024.0 * 1024.0),
+            row.failed_compiles);
+
+        ss << line;
+    }
+
+    std::string table = ss.str();
+    printf("%s", table.c_str());
+
+    std::vector<uint8_t> table_bytes(table.begin(), table.end());
+    WriteFile(work_path + "compile_cost.md", table_bytes);
+
+    return 0;
+}
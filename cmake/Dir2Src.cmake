@@ -0,0 +1,380 @@
+# Dir2Src.cmake
+#
+# Build-time resource embedding with dir2src.
+#
+#   dir2src_add_resources(<target>
+#       DIR <input-dir>
+#       [NAMESPACE <name>]        # root namespace, default "Bin"
+#       [FORMAT <array|hex>]      # dir2src --format, default "array"
+#       [SHARDS <count>]          # generated translation units, default 8
+#       [INCLUDE <glob>...]       # dir2src --include
+#       [EXCLUDE <glob>...]       # dir2src --exclude
+#       [MINIFY]                  # dir2src --minify
+#       [NUL_TERMINATE <glob>...] # dir2src --nul-terminate
+#       [BULK_FILE_SIZE <size>]   # dir2src --bulk-file-size, see below
+#       [BULK_FALLBACK]           # dir2src --bulk-fallback, with BULK_FILE_SIZE
+#       [INDEX]                   # also generate the runtime path index
+#       [PACK]                    # map files from bin.pack instead, see below
+#       [DEV]                     # map files from DIR instead, see below
+#       [MODULE <name>]           # also export the files from a C++20 module
+#       [LAYOUT_PROFILE <file>]   # dir2src --layout-profile, see below
+#       [PRUNE_UNPROFILED]        # dir2src --prune-unprofiled, with LAYOUT_PROFILE
+#       [PAGE_ALIGN <size>]       # dir2src --page-align, adds Release()
+#       [CHECKSUM]                # dir2src --checksum, adds Verify(); not with PACK
+#       [HTTP_METADATA]           # dir2src --http-metadata; not with PACK
+#       [SOURCE_DATE_EPOCH <t>]   # dir2src --source-date-epoch, with HTTP_METADATA
+#       [GZIP <percent>]          # dir2src --gzip, adds <name>_gz; not with PACK
+#       [COMPRESS <glob>...]      # dir2src --compress, adds ReadAt(); not with PACK
+#       [CHUNK_SIZE <size>]       # dir2src --chunk-size, default 64K
+#       [INSTRUMENT]              # dir2src --instrument, see below; with INDEX
+#       [OUTPUT_DIR <dir>])       # default ${CMAKE_CURRENT_BINARY_DIR}/dir2src/<target>/<namespace>
+#
+# Each shard is its own custom command, so shards are generated and compiled
+# in parallel. Every command writes a depfile naming the input files and
+# directories it read, so adding, removing or editing an asset reruns only
+# what depends on it, and --restat leaves unchanged outputs untouched so
+# their objects aren't rebuilt. <OUTPUT_DIR>/bin.h is reachable as "bin.h"
+# from <target>.
+#
+# With BULK_FILE_SIZE, files of at least that size leave their shard's
+# initializer for a raw copy the assembler embeds. The shards define
+# DIR2SRC_BULK_DIR, so the copies are found whatever -ffile-prefix-map does
+# to __FILE__. Compilers without GNU inline assembly need BULK_FALLBACK.
+#
+# With PACK, one command writes <OUTPUT_DIR>/bin.pack and the runtime that
+# maps it at startup. Code reads the same as against embedded files, and
+# an asset edit only rewrites the pack, so nothing is recompiled or
+# relinked. Meant for development builds, e.g. PACK behind an option: the
+# runtime looks for the pack by its absolute path in <OUTPUT_DIR>, so it's
+# found from any working directory but only on the machine that built it.
+# Call SetPackPath() before the first lookup to ship the pack elsewhere.
+#
+# With DEV, one command writes only bin.h and bin_dev.cpp, and <target>
+# defines DIR2SRC_DEV. Each file is mapped from DIR the first time it's
+# read, so no asset is ever compiled and edits show up on the next run.
+#
+# With MODULE, the generated module interface units are added to <target>
+# as a CXX_MODULES file set, so `import <name>;` works alongside bin.h. The
+# module has a partition per directory in DIR, found when configuring, so
+# adding or renaming one reconfigures. Needs CMake 3.28.
+#
+# With LAYOUT_PROFILE, the files listed in <file>, one path per line in
+# the order the program first reads them, are laid out first and together.
+# MSVC needs nothing more. ELF targets link with
+# -Wl,--symbol-ordering-file=<OUTPUT_DIR>/bin.order under lld, or
+# -Wl,--sort-section=name under GNU ld.
+#
+# With INSTRUMENT, the files the program finds, reads by name, or lists
+# and reads through File::Bytes() are counted, and it writes them with
+# WriteAccessProfile(). The profile, as LAYOUT_PROFILE, lays them out in
+# the order they were first accessed, and PRUNE_UNPROFILED then leaves out
+# the rest, including listed files only read through File::data.
+#
+# A .dir2srcignore in DIR adds exclude globs, one per line, and is tracked
+# through the depfile like any other input.
+#
+# dir2src is taken from the dir2src target when it exists in the build,
+# otherwise from DIR2SRC_EXECUTABLE or the PATH.
+
+if(CMAKE_VERSION VERSION_LESS 3.20)
+    message(FATAL_ERROR "Dir2Src.cmake requires CMake 3.20 or later for DEPFILE support")
+endif()
+
+# Depfile paths relative to the build directory, as ninja expects
+if(POLICY CMP0116)
+    cmake_policy(SET CMP0116 NEW)
+endif()
+
+function(dir2src_add_resources target)
+    cmake_parse_arguments(PARSE_ARGV 1 ARG "INDEX;PACK;DEV;MINIFY;CHECKSUM;HTTP_METADATA;INSTRUMENT;PRUNE_UNPROFILED;BULK_FALLBACK" "DIR;NAMESPACE;FORMAT;SHARDS;OUTPUT_DIR;MODULE;LAYOUT_PROFILE;PAGE_ALIGN;GZIP;CHUNK_SIZE;BULK_FILE_SIZE;SOURCE_DATE_EPOCH" "INCLUDE;EXCLUDE;NUL_TERMINATE;COMPRESS")
+
+    if(NOT ARG_DIR)
+        message(FATAL_ERROR "dir2src_add_resources: DIR is required")
+    endif()
+
+    if(NOT ARG_NAMESPACE)
+        set(ARG_NAMESPACE "Bin")
+    endif()
+
+    if(NOT ARG_FORMAT)
+        set(ARG_FORMAT "array")
+    endif()
+
+    if(NOT ARG_SHARDS)
+        set(ARG_SHARDS 8)
+    endif()
+
+    if(NOT ARG_OUTPUT_DIR)
+        set(ARG_OUTPUT_DIR "${CMAKE_CURRENT_BINARY_DIR}/dir2src/${target}/${ARG_NAMESPACE}")
+    endif()
+
+    # The pack runtime names its pack by this path
+    get_filename_component(ARG_OUTPUT_DIR "${ARG_OUTPUT_DIR}" ABSOLUTE BASE_DIR "${CMAKE_CURRENT_BINARY_DIR}")
+
+    get_filename_component(input_dir "${ARG_DIR}" ABSOLUTE BASE_DIR "${CMAKE_CURRENT_SOURCE_DIR}")
+
+    if(TARGET dir2src)
+        set(dir2src_command "$<TARGET_FILE:dir2src>")
+        set(dir2src_depends dir2src)
+    else()
+        find_program(DIR2SRC_EXECUTABLE dir2src REQUIRED)
+        set(dir2src_command "${DIR2SRC_EXECUTABLE}")
+        set(dir2src_depends "${DIR2SRC_EXECUTABLE}")
+    endif()
+
+    set(index_args "")
+    if(ARG_INDEX)
+        set(index_args --index)
+    endif()
+
+    set(text_args "")
+    if(ARG_MINIFY)
+        set(text_args --minify)
+    endif()
+    foreach(glob IN LISTS ARG_NUL_TERMINATE)
+        list(APPEND text_args --nul-terminate "${glob}")
+    endforeach()
+
+    # Only shards are compiled, so only they route by size
+    set(bulk_args "")
+    if(ARG_BULK_FILE_SIZE)
+        set(bulk_args --bulk-file-size "${ARG_BULK_FILE_SIZE}")
+        if(ARG_BULK_FALLBACK)
+            list(APPEND bulk_args --bulk-fallback)
+        endif()
+    endif()
+
+    # Runtimes written along with bin.h: Release() in bin_release.cpp
+    set(runtime_args "")
+    set(runtime_sources "")
+    if(ARG_PAGE_ALIGN)
+        set(runtime_args --page-align "${ARG_PAGE_ALIGN}")
+        set(runtime_sources "${ARG_OUTPUT_DIR}/bin_release.cpp")
+    endif()
+
+    # Likewise Crc32c() and Verify() in bin_checksum.cpp. A pack's contents
+    # aren't compiled in, so neither are its checksums.
+    if(ARG_CHECKSUM AND NOT ARG_PACK)
+        list(APPEND runtime_args --checksum)
+        list(APPEND runtime_sources "${ARG_OUTPUT_DIR}/bin_checksum.cpp")
+    endif()
+
+    # Declared in bin.h alone. Without SOURCE_DATE_EPOCH here or in the
+    # environment, touching a file changes bin.h.
+    if(ARG_HTTP_METADATA AND NOT ARG_PACK)
+        list(APPEND runtime_args --http-metadata)
+        if(DEFINED ARG_SOURCE_DATE_EPOCH)
+            list(APPEND runtime_args --source-date-epoch "${ARG_SOURCE_DATE_EPOCH}")
+        endif()
+    endif()
+
+    # Declared in bin.h, defined next to each file by its shard
+    if(ARG_GZIP AND NOT ARG_PACK)
+        list(APPEND runtime_args --gzip "${ARG_GZIP}")
+    endif()
+
+    # Likewise ReadAt() in bin_compressed.cpp, which can inflate on threads
+    # of its own. Packs are read in place, uncompressed.
+    if(ARG_COMPRESS AND NOT ARG_PACK)
+        foreach(glob IN LISTS ARG_COMPRESS)
+            list(APPEND runtime_args --compress "${glob}")
+        endforeach()
+        if(ARG_CHUNK_SIZE)
+            list(APPEND runtime_args --chunk-size "${ARG_CHUNK_SIZE}")
+        endif()
+        list(APPEND runtime_sources "${ARG_OUTPUT_DIR}/bin_compressed.cpp")
+
+        find_package(Threads REQUIRED)
+        target_link_libraries(${target} PRIVATE Threads::Threads)
+    endif()
+
+    # Likewise WriteAccessProfile() in bin_profile.cpp, counted by Find()
+    if(ARG_INSTRUMENT AND NOT ARG_PACK)
+        if(NOT ARG_INDEX)
+            message(FATAL_ERROR "dir2src_add_resources: INSTRUMENT requires INDEX")
+        endif()
+        list(APPEND runtime_args --instrument)
+        list(APPEND runtime_sources "${ARG_OUTPUT_DIR}/bin_profile.cpp")
+    endif()
+
+    # Tracked through the depfile like the inputs
+    set(layout_args "")
+    set(layout_files "")
+    if(ARG_LAYOUT_PROFILE)
+        get_filename_component(layout_profile "${ARG_LAYOUT_PROFILE}" ABSOLUTE BASE_DIR "${CMAKE_CURRENT_SOURCE_DIR}")
+        set(layout_args --layout-profile "${layout_profile}")
+        set(layout_files "${ARG_OUTPUT_DIR}/bin.order")
+        if(ARG_PRUNE_UNPROFILED)
+            list(APPEND layout_args --prune-unprofiled)
+        endif()
+    endif()
+
+    set(filter_args "")
+    foreach(glob IN LISTS ARG_INCLUDE)
+        list(APPEND filter_args --include "${glob}")
+    endforeach()
+    foreach(glob IN LISTS ARG_EXCLUDE)
+        list(APPEND filter_args --exclude "${glob}")
+    endforeach()
+
+    # One interface unit per directory in DIR, named as dir2src names their
+    # namespaces
+    set(module_args "")
+    set(module_files "")
+    if(ARG_MODULE)
+        if(CMAKE_VERSION VERSION_LESS 3.28)
+            message(FATAL_ERROR "dir2src_add_resources: MODULE requires CMake 3.28 or later")
+        endif()
+
+        set(module_args --module "${ARG_MODULE}")
+        list(APPEND module_files "${ARG_OUTPUT_DIR}/bin.cppm")
+
+        file(GLOB top_level_entries LIST_DIRECTORIES true CONFIGURE_DEPENDS RELATIVE "${input_dir}" "${input_dir}/*")
+        foreach(entry IN LISTS top_level_entries)
+            if(IS_DIRECTORY "${input_dir}/${entry}")
+                string(REGEX REPLACE "^[^A-Za-z0-9]+" "" partition "${entry}")
+                string(REGEX REPLACE "[^A-Za-z0-9]" "_" partition "${partition}")
+                if(partition STREQUAL "" OR partition MATCHES "^[0-9]")
+                    string(PREPEND partition "_")
+                endif()
+
+                list(APPEND module_files "${ARG_OUTPUT_DIR}/bin-${partition}.cppm")
+            endif()
+        endforeach()
+        list(REMOVE_DUPLICATES module_files)
+
+        string(MAKE_C_IDENTIFIER "dir2src_${ARG_NAMESPACE}" file_set)
+        string(TOLOWER "${file_set}" file_set)
+        target_sources(${target} PUBLIC FILE_SET ${file_set} TYPE CXX_MODULES BASE_DIRS "${ARG_OUTPUT_DIR}" FILES ${module_files})
+        target_compile_features(${target} PUBLIC cxx_std_20)
+    endif()
+
+    set(generated_sources "")
+
+    if(ARG_PACK)
+        set(stamp "${ARG_OUTPUT_DIR}/bin.stamp")
+        set(depfile "${ARG_OUTPUT_DIR}/bin.d")
+
+        add_custom_command(
+            OUTPUT "${stamp}"
+            BYPRODUCTS "${ARG_OUTPUT_DIR}/bin.h" "${ARG_OUTPUT_DIR}/bin_pack.cpp" "${ARG_OUTPUT_DIR}/bin.pack" ${runtime_sources} ${module_files}
+            COMMAND "${dir2src_command}"
+                --root-namespace "${ARG_NAMESPACE}"
+                --pack
+                --pack-path "${ARG_OUTPUT_DIR}/bin.pack"
+                --restat
+                --stamp "${stamp}"
+                --depfile "${depfile}"
+                ${filter_args}
+                ${text_args}
+                ${module_args}
+                ${layout_args}
+                ${runtime_args}
+                "${input_dir}"
+                "${ARG_OUTPUT_DIR}"
+            DEPENDS ${dir2src_depends}
+            DEPFILE "${depfile}"
+            COMMENT "Packing ${ARG_NAMESPACE} resources for ${target}"
+            VERBATIM
+        )
+
+        target_sources(${target} PRIVATE "${stamp}" "${ARG_OUTPUT_DIR}/bin.h" "${ARG_OUTPUT_DIR}/bin_pack.cpp" ${runtime_sources})
+        target_include_directories(${target} PUBLIC "${ARG_OUTPUT_DIR}")
+        return()
+    endif()
+
+    if(ARG_DEV)
+        set(stamp "${ARG_OUTPUT_DIR}/bin.stamp")
+        set(depfile "${ARG_OUTPUT_DIR}/bin.d")
+
+        set(byproducts "${ARG_OUTPUT_DIR}/bin.h" "${ARG_OUTPUT_DIR}/bin_dev.cpp" ${runtime_sources})
+        if(ARG_INDEX)
+            list(APPEND byproducts "${ARG_OUTPUT_DIR}/bin_index.cpp")
+        endif()
+
+        add_custom_command(
+            OUTPUT "${stamp}"
+            BYPRODUCTS ${byproducts} ${module_files}
+            COMMAND "${dir2src_command}"
+                --root-namespace "${ARG_NAMESPACE}"
+                --dev
+                --header-only
+                --restat
+                --stamp "${stamp}"
+                --depfile "${depfile}"
+                ${filter_args}
+                ${text_args}
+                ${index_args}
+                ${module_args}
+                ${runtime_args}
+                "${input_dir}"
+                "${ARG_OUTPUT_DIR}"
+            DEPENDS ${dir2src_depends}
+            DEPFILE "${depfile}"
+            COMMENT "Generating ${ARG_NAMESPACE} dev accessors for ${target}"
+            VERBATIM
+        )
+
+        target_sources(${target} PRIVATE "${stamp}" ${byproducts})
+        target_include_directories(${target} PUBLIC "${ARG_OUTPUT_DIR}")
+        target_compile_definitions(${target} PUBLIC DIR2SRC_DEV)
+        return()
+    endif()
+
+    math(EXPR last_shard "${ARG_SHARDS} - 1")
+
+    foreach(shard RANGE ${last_shard})
+        set(stamp "${ARG_OUTPUT_DIR}/bin_${shard}.stamp")
+        set(depfile "${ARG_OUTPUT_DIR}/bin_${shard}.d")
+
+        set(byproducts "${ARG_OUTPUT_DIR}/bin_${shard}.cpp")
+        # Also written by shard 0, but not compiled as ordinary sources
+        set(header_byproducts "")
+        if(shard EQUAL 0)
+            list(PREPEND byproducts "${ARG_OUTPUT_DIR}/bin.h")
+            list(APPEND byproducts ${runtime_sources})
+            set(header_byproducts ${module_files} ${layout_files})
+
+            if(ARG_INDEX)
+                list(APPEND byproducts "${ARG_OUTPUT_DIR}/bin_index.cpp")
+            endif()
+        endif()
+
+        # The stamp is always written, the generated sources only when they
+        # change; ninja restats byproducts so unchanged shards don't recompile
+        add_custom_command(
+            OUTPUT "${stamp}"
+            BYPRODUCTS ${byproducts} ${header_byproducts}
+            COMMAND "${dir2src_command}"
+                --root-namespace "${ARG_NAMESPACE}"
+                --format "${ARG_FORMAT}"
+                --shard "${shard}/${ARG_SHARDS}"
+                --restat
+                --stamp "${stamp}"
+                --depfile "${depfile}"
+                ${filter_args}
+                ${text_args}
+                ${bulk_args}
+                ${index_args}
+                ${module_args}
+                ${layout_args}
+                ${runtime_args}
+                "${input_dir}"
+                "${ARG_OUTPUT_DIR}"
+            DEPENDS ${dir2src_depends}
+            DEPFILE "${depfile}"
+            COMMENT "Generating ${ARG_NAMESPACE} resources for ${target} (shard ${shard}/${ARG_SHARDS})"
+            VERBATIM
+        )
+
+        if(ARG_BULK_FILE_SIZE)
+            set_source_files_properties("${ARG_OUTPUT_DIR}/bin_${shard}.cpp" TARGET_DIRECTORY ${target}
+                PROPERTIES COMPILE_DEFINITIONS "DIR2SRC_BULK_DIR=\"${ARG_OUTPUT_DIR}\"")
+        endif()
+
+        list(APPEND generated_sources "${stamp}" ${byproducts})
+    endforeach()
+
+    target_sources(${target} PRIVATE ${generated_sources})
+    target_include_directories(${target} PUBLIC "${ARG_OUTPUT_DIR}")
+endfunction()
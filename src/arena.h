@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace dir2src {
+
+// Bump allocator for data living as long as a run: paths, names and
+// namespaces. Memory comes from large blocks and is only given back when the
+// arena is destroyed, so steady-state allocations cost a pointer increment.
+// Not thread safe; concurrent stages each use their own.
+class Arena {
+public:
+    explicit Arena(size_t block_size = 64 << 10) : block_size(block_size) {}
+
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        uintptr_t aligned = (cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+        if (blocks.empty() || aligned + size > end) {
+            // Oversized requests get a block of their own
+            size_t new_block_size = std::max(block_size, size + alignment);
+
+            blocks.push_back(std::make_unique<uint8_t[]>(new_block_size));
+            cursor = (uintptr_t)blocks.back().get();
+            end = cursor + new_block_size;
+
+            aligned = (cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        }
+
+        cursor = aligned + size;
+        return (void*)aligned;
+    }
+
+    // Only for types needing no destructor, the arena never runs them
+    template <typename T>
+    std::span<T> AllocateArray(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>);
+
+        T* data = (T*)Allocate(sizeof(T) * count, alignof(T));
+        std::uninitialized_value_construct_n(data, count);
+
+        return { data, count };
+    }
+
+    std::string_view CopyString(std::string_view str) {
+        return Concat({ str });
+    }
+
+    std::string_view Concat(std::initializer_list<std::string_view> strs) {
+        size_t size = 0;
+        for (auto str : strs) size += str.size();
+
+        char* data = (char*)Allocate(size, 1);
+
+        char* out = data;
+        for (auto str : strs) {
+            memcpy(out, str.data(), str.size());
+            out += str.size();
+        }
+
+        return { data, size };
+    }
+
+private:
+    size_t block_size;
+
+    std::vector<std::unique_ptr<uint8_t[]>> blocks;
+    uintptr_t cursor = 0;
+    uintptr_t end = 0;
+};
+
+} // namespace dir2src
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace dir2src {
+
+// Bounded lock-free multi-producer multi-consumer queue. Each cell carries a
+// sequence number saying whether it's ready to be written or read for the
+// current lap, so producers and consumers only contend on their own index.
+template <typename T>
+class BoundedQueue {
+public:
+    // Capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t min_capacity) {
+        size_t capacity = 2;
+        while (capacity < min_capacity) capacity <<= 1;
+
+        cells = std::make_unique<Cell[]>(capacity);
+        mask = capacity - 1;
+
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Leaves `value` untouched and returns false if the queue is full
+    bool TryPush(T& value) {
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+
+            if (diff == 0) {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty
+    bool TryPop(T* value) {
+        size_t position = dequeue_position.load(std::memory_order_relaxed);
+
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+
+            if (diff == 0) {
+                if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    *value = std::move(cell.value);
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                position = dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Blocking variants. A full queue is the backpressure that keeps fast
+    // stages from running ahead of slow ones, so waiting sleeps rather than
+    // burning the core the slow stage may need.
+    void Push(T value) {
+        while (true) {
+            uint32_t popped = popped_count.load(std::memory_order_acquire);
+
+            if (TryPush(value)) break;
+
+            popped_count.wait(popped, std::memory_order_acquire);
+        }
+
+        pushed_count.fetch_add(1, std::memory_order_release);
+        pushed_count.notify_all();
+    }
+
+    T Pop() {
+        T value;
+
+        while (true) {
+            uint32_t pushed = pushed_count.load(std::memory_order_acquire);
+
+            if (TryPop(&value)) break;
+
+            pushed_count.wait(pushed, std::memory_order_acquire);
+        }
+
+        popped_count.fetch_add(1, std::memory_order_release);
+        popped_count.notify_all();
+
+        return value;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+
+    alignas(64) std::atomic<size_t> enqueue_position = 0;
+    alignas(64) std::atomic<size_t> dequeue_position = 0;
+
+    // Bumped after each completed push and pop, for blocked callers to wait on
+    alignas(64) std::atomic<uint32_t> pushed_count = 0;
+    alignas(64) std::atomic<uint32_t> popped_count = 0;
+};
+
+} // namespace dir2src
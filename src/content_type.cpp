@@ -0,0 +1,177 @@
+#include "content_type.h"
+
+#include <cctype>
+#include <cstring>
+
+namespace dir2src {
+
+namespace {
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::tolower((uint8_t)a[i]) != std::tolower((uint8_t)b[i])) return false;
+    }
+
+    return true;
+}
+
+constexpr std::string_view text_plain = "text/plain; charset=utf-8";
+constexpr std::string_view octet_stream = "application/octet-stream";
+
+std::string_view ContentTypeOfExtension(std::string_view path) {
+    const size_t dot_idx = path.rfind('.');
+    if (dot_idx == std::string_view::npos || path.find('/', dot_idx) != std::string_view::npos) {
+        return {};
+    }
+
+    const std::string_view extension = path.substr(dot_idx + 1);
+
+    constexpr struct {
+        std::string_view extension;
+        std::string_view content_type;
+    } extension_content_types[] = {
+        { "html", "text/html; charset=utf-8" },
+        { "htm", "text/html; charset=utf-8" },
+        { "css", "text/css; charset=utf-8" },
+        { "js", "text/javascript; charset=utf-8" },
+        { "mjs", "text/javascript; charset=utf-8" },
+        { "json", "application/json" },
+        { "map", "application/json" },
+        { "webmanifest", "application/manifest+json" },
+        { "xml", "application/xml" },
+        { "txt", text_plain },
+        { "csv", "text/csv; charset=utf-8" },
+        { "md", "text/markdown; charset=utf-8" },
+        { "svg", "image/svg+xml" },
+        { "png", "image/png" },
+        { "jpg", "image/jpeg" },
+        { "jpeg", "image/jpeg" },
+        { "gif", "image/gif" },
+        { "webp", "image/webp" },
+        { "avif", "image/avif" },
+        { "bmp", "image/bmp" },
+        { "ico", "image/vnd.microsoft.icon" },
+        { "woff", "font/woff" },
+        { "woff2", "font/woff2" },
+        { "ttf", "font/ttf" },
+        { "otf", "font/otf" },
+        { "wasm", "application/wasm" },
+        { "pdf", "application/pdf" },
+        { "zip", "application/zip" },
+        { "gz", "application/gzip" },
+        { "mp3", "audio/mpeg" },
+        { "ogg", "audio/ogg" },
+        { "wav", "audio/wav" },
+        { "mp4", "video/mp4" },
+        { "webm", "video/webm" },
+    };
+
+    for (const auto& entry : extension_content_types) {
+        if (EqualsIgnoreCase(extension, entry.extension)) return entry.content_type;
+    }
+
+    return {};
+}
+
+bool StartsWith(std::span<const uint8_t> data, std::string_view signature, size_t offset = 0) {
+    return data.size() >= offset + signature.size() && memcmp(data.data() + offset, signature.data(), signature.size()) == 0;
+}
+
+// Well-formed UTF-8 without control characters but whitespace
+bool IsText(std::span<const uint8_t> data) {
+    for (size_t i = 0; i < data.size();) {
+        const uint8_t c = data[i];
+
+        if (c < 0x80) {
+            if (c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f') return false;
+            if (c == 0x7F) return false;
+
+            ++i;
+            continue;
+        }
+
+        size_t continuation_count = 0;
+        if (c >= 0xC2 && c <= 0xDF) continuation_count = 1;
+        else if (c >= 0xE0 && c <= 0xEF) continuation_count = 2;
+        else if (c >= 0xF0 && c <= 0xF4) continuation_count = 3;
+        else return false;
+
+        if (data.size() - i <= continuation_count) return false;
+
+        for (size_t k = 1; k <= continuation_count; ++k) {
+            if ((data[i + k] & 0xC0) != 0x80) return false;
+        }
+
+        i += continuation_count + 1;
+    }
+
+    return true;
+}
+
+std::string_view ContentTypeOfData(std::span<const uint8_t> data) {
+    using namespace std::string_view_literals;
+
+    constexpr struct {
+        std::string_view signature;
+        std::string_view content_type;
+    } signature_content_types[] = {
+        { "\x89PNG\r\n\x1A\n"sv, "image/png" },
+        { "\xFF\xD8\xFF"sv, "image/jpeg" },
+        { "GIF87a"sv, "image/gif" },
+        { "GIF89a"sv, "image/gif" },
+        { "%PDF-"sv, "application/pdf" },
+        { "\0asm"sv, "application/wasm" },
+        { "wOFF"sv, "font/woff" },
+        { "wOF2"sv, "font/woff2" },
+        { "PK\x03\x04"sv, "application/zip" },
+        { "\x1F\x8B"sv, "application/gzip" },
+        { "OggS"sv, "audio/ogg" },
+        { "ID3"sv, "audio/mpeg" },
+    };
+
+    for (const auto& entry : signature_content_types) {
+        if (StartsWith(data, entry.signature)) return entry.content_type;
+    }
+
+    if (StartsWith(data, "RIFF") && StartsWith(data, "WEBP", 8)) return "image/webp";
+    if (StartsWith(data, "RIFF") && StartsWith(data, "WAVE", 8)) return "audio/wav";
+
+    // A UTF-8 byte order mark is still text
+    if (StartsWith(data, "\xEF\xBB\xBF")) data = data.subspan(3);
+
+    return IsText(data) ? text_plain : octet_stream;
+}
+
+} // namespace
+
+std::string_view ContentTypeOf(std::string_view path, std::span<const uint8_t> data) {
+    const std::string_view content_type = ContentTypeOfExtension(path);
+    return content_type.empty() ? ContentTypeOfData(data) : content_type;
+}
+
+bool IsCompressible(std::string_view content_type) {
+    if (content_type.starts_with("audio/") || content_type.starts_with("video/")) return false;
+
+    constexpr std::string_view compressed_content_types[] = {
+        "image/png",
+        "image/jpeg",
+        "image/gif",
+        "image/webp",
+        "image/avif",
+        "font/woff",
+        "font/woff2",
+        "application/pdf",
+        "application/zip",
+        "application/gzip",
+    };
+
+    for (auto compressed_content_type : compressed_content_types) {
+        if (content_type == compressed_content_type) return false;
+    }
+
+    return true;
+}
+
+} // namespace dir2src
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace dir2src {
+
+// The media type an HTTP server would send a file as. Picked by extension,
+// ignoring case, or else from the file's first bytes: a known signature,
+// then UTF-8 text, then application/octet-stream. Text types name their
+// charset as UTF-8.
+std::string_view ContentTypeOf(std::string_view path, std::span<const uint8_t> data);
+
+// Whether files of the type are worth compressing for transfer: false for
+// formats that are compressed already, such as most images, fonts, audio,
+// video and archives
+bool IsCompressible(std::string_view content_type);
+
+} // namespace dir2src
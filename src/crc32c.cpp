@@ -0,0 +1,222 @@
+#include "crc32c.h"
+
+#include <cstring>
+#include <utility>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#define DIR2SRC_CRC32C_SSE42
+#endif
+
+namespace dir2src {
+
+namespace {
+
+// Reflected Castagnoli polynomial
+constexpr uint32_t crc32c_polynomial = 0x82F63B78;
+
+// The hardware path hashes three blocks of this many bytes at once, then
+// shifts the first two over the bytes after them and combines the three
+constexpr size_t long_block_size = 8192;
+constexpr size_t short_block_size = 256;
+
+// Operators on the CRC register as 32x32 bit matrices over GF(2), one
+// column per bit
+uint32_t MatrixTimes(const uint32_t* matrix, uint32_t vector) {
+    uint32_t sum = 0;
+
+    for (; vector != 0; vector >>= 1, ++matrix) {
+        if (vector & 1) sum ^= *matrix;
+    }
+
+    return sum;
+}
+
+void MatrixSquare(uint32_t* square, const uint32_t* matrix) {
+    for (int n = 0; n < 32; ++n) {
+        square[n] = MatrixTimes(matrix, matrix[n]);
+    }
+}
+
+// Feeding `size` zero bytes through the register, for a power of two size
+void ZerosOperator(uint32_t* even, size_t size) {
+    uint32_t odd[32];
+
+    // One zero bit
+    odd[0] = crc32c_polynomial;
+    for (int n = 1; n < 32; ++n) {
+        odd[n] = 1u << (n - 1);
+    }
+
+    // Two, then four zero bits
+    MatrixSquare(even, odd);
+    MatrixSquare(odd, even);
+
+    // Each square doubles it, from one byte on
+    for (;;) {
+        MatrixSquare(even, odd);
+        size >>= 1;
+        if (size == 0) return;
+
+        MatrixSquare(odd, even);
+        size >>= 1;
+        if (size == 0) break;
+    }
+
+    memcpy(even, odd, sizeof(odd));
+}
+
+struct Crc32cTables {
+    // Slicing-by-8, for CPUs without the instruction
+    uint32_t bytes[8][256];
+
+    // The zeros operators applied a byte of the register at a time
+    uint32_t long_shift[4][256];
+    uint32_t short_shift[4][256];
+};
+
+void FillShiftTable(uint32_t (*shift)[256], size_t size) {
+    uint32_t op[32];
+    ZerosOperator(op, size);
+
+    for (uint32_t n = 0; n < 256; ++n) {
+        shift[0][n] = MatrixTimes(op, n);
+        shift[1][n] = MatrixTimes(op, n << 8);
+        shift[2][n] = MatrixTimes(op, n << 16);
+        shift[3][n] = MatrixTimes(op, n << 24);
+    }
+}
+
+const Crc32cTables& GetCrc32cTables() {
+    static const Crc32cTables tables = [] {
+        Crc32cTables t = {};
+
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t crc = n;
+            for (int k = 0; k < 8; ++k) {
+                crc = crc & 1 ? (crc >> 1) ^ crc32c_polynomial : crc >> 1;
+            }
+            t.bytes[0][n] = crc;
+        }
+
+        for (uint32_t n = 0; n < 256; ++n) {
+            for (int k = 1; k < 8; ++k) {
+                t.bytes[k][n] = (t.bytes[k - 1][n] >> 8) ^ t.bytes[0][t.bytes[k - 1][n] & 0xFF];
+            }
+        }
+
+        FillShiftTable(t.long_shift, long_block_size);
+        FillShiftTable(t.short_shift, short_block_size);
+
+        return t;
+    }();
+
+    return tables;
+}
+
+uint32_t Crc32cPortable(uint32_t crc, const uint8_t* data, size_t size) {
+    const auto& bytes = GetCrc32cTables().bytes;
+
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low, high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc;
+
+        crc = bytes[7][low & 0xFF] ^ bytes[6][(low >> 8) & 0xFF] ^ bytes[5][(low >> 16) & 0xFF] ^ bytes[4][low >> 24] ^
+              bytes[3][high & 0xFF] ^ bytes[2][(high >> 8) & 0xFF] ^ bytes[1][(high >> 16) & 0xFF] ^ bytes[0][high >> 24];
+    }
+
+    for (; size > 0; ++data, --size) {
+        crc = (crc >> 8) ^ bytes[0][(crc ^ *data) & 0xFF];
+    }
+
+    return crc;
+}
+
+#if defined(DIR2SRC_CRC32C_SSE42)
+
+bool HasSse42() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+uint32_t Shift(const uint32_t (*shift)[256], uint32_t crc) {
+    return shift[0][crc & 0xFF] ^ shift[1][(crc >> 8) & 0xFF] ^ shift[2][(crc >> 16) & 0xFF] ^ shift[3][crc >> 24];
+}
+
+uint64_t Load64(const uint8_t* data) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    return word;
+}
+
+#if !defined(_MSC_VER)
+__attribute__((target("sse4.2")))
+#endif
+uint32_t Crc32cSse42(uint32_t crc, const uint8_t* data, size_t size) {
+    const Crc32cTables& tables = GetCrc32cTables();
+
+    // The instruction's latency is three times its throughput, so three
+    // independent blocks keep it busy
+    uint64_t crc0 = crc;
+
+    for (auto [block_size, shift] : { std::pair{ long_block_size, tables.long_shift }, std::pair{ short_block_size, tables.short_shift } }) {
+        for (; size >= 3 * block_size; data += 3 * block_size, size -= 3 * block_size) {
+            uint64_t crc1 = 0;
+            uint64_t crc2 = 0;
+
+            for (size_t i = 0; i < block_size; i += 8) {
+                crc0 = _mm_crc32_u64(crc0, Load64(data + i));
+                crc1 = _mm_crc32_u64(crc1, Load64(data + block_size + i));
+                crc2 = _mm_crc32_u64(crc2, Load64(data + 2 * block_size + i));
+            }
+
+            crc0 = Shift(shift, (uint32_t)crc0) ^ crc1;
+            crc0 = Shift(shift, (uint32_t)crc0) ^ crc2;
+        }
+    }
+
+    for (; size >= 8; data += 8, size -= 8) {
+        crc0 = _mm_crc32_u64(crc0, Load64(data));
+    }
+
+    crc = (uint32_t)crc0;
+
+    for (; size > 0; ++data, --size) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+
+    return crc;
+}
+
+#endif
+
+} // namespace
+
+uint32_t Crc32c(std::span<const uint8_t> data) {
+    uint32_t crc = 0xFFFFFFFF;
+
+#if defined(DIR2SRC_CRC32C_SSE42)
+    static const bool has_sse42 = HasSse42();
+
+    if (has_sse42) {
+        return ~Crc32cSse42(crc, data.data(), data.size());
+    }
+#endif
+
+    return ~Crc32cPortable(crc, data.data(), data.size());
+}
+
+} // namespace dir2src
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace dir2src {
+
+// CRC-32C (Castagnoli), as the generated Crc32c() computes it. Uses the
+// SSE4.2 CRC instruction where the CPU has it.
+uint32_t Crc32c(std::span<const uint8_t> data);
+
+} // namespace dir2src
@@ -0,0 +1,4530 @@
+#include "dir2src.h"
+#include "bounded_queue.h"
+#include "content_type.h"
+#include "crc32c.h"
+#include "gzip.h"
+#include "minify.h"
+#include "path_filter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <span>
+#include <unordered_map>
+
+#define NOMINMAX
+#include <Windows.h>
+
+namespace dir2src {
+
+namespace {
+
+// FILETIMEs count 100 ns intervals from 1601
+int64_t UnixTime(FILETIME file_time) {
+    const int64_t intervals = (int64_t)(((uint64_t)file_time.dwHighDateTime << 32) | file_time.dwLowDateTime);
+    return intervals / 10000000 - 11644473600;
+}
+
+bool ReadDiskFile(const std::string& file_path, std::vector<uint8_t>* output_buffer) {
+    HANDLE h_input_file = ::CreateFile(
+        file_path.c_str(),     // lpFileName
+        GENERIC_READ,          // dwDesiredAccess
+        0,                     // dwShareMode
+        NULL,                  // lpSecurityAttributes
+        OPEN_EXISTING,         // dwCreeationDisposition
+        FILE_ATTRIBUTE_NORMAL, // dwFlagsAndAttributes
+        NULL                   // hTemplateFile
+    );
+
+    if (h_input_file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to open input file: %lu", GetLastError());
+        return false;
+    }
+
+    DWORD file_size = ::GetFileSize(h_input_file, nullptr);
+
+    output_buffer->resize(static_cast<size_t>(file_size));
+
+    DWORD number_of_bytes_read;
+    BOOL read_success = ::ReadFile(h_input_file, output_buffer->data(), file_size, &number_of_bytes_read, NULL);
+
+    if (!read_success) {
+        fprintf(stderr, "Failed to read input file: %lu", GetLastError());
+        CloseHandle(h_input_file);
+        return false;
+    }
+
+    CloseHandle(h_input_file);
+    return true;
+}
+
+bool WriteDiskFile(const std::string& file_path, std::string_view contents) {
+    HANDLE h_output_file = ::CreateFile(
+        file_path.c_str(),     // lpFileName
+        GENERIC_WRITE,         // dwDesiredAccess
+        0,                     // dwShareMode
+        NULL,                  // lpSecurityAttributes
+        CREATE_ALWAYS,         // dwCreeationDisposition
+        FILE_ATTRIBUTE_NORMAL, // dwFlagsAndAttributes
+        NULL                   // hTemplateFile
+    );
+
+    if (h_output_file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to create output file: %lu", GetLastError());
+        CloseHandle(h_output_file);
+        return false;
+    }
+
+    DWORD number_of_bytes_written;
+
+    BOOL write_success = ::WriteFile(
+        h_output_file,
+        contents.data(),
+        (DWORD)contents.size(),
+        &number_of_bytes_written,
+        NULL
+    );
+
+    if (!write_success) {
+        fprintf(stderr, "Failed to write output file: %lu", GetLastError());
+        CloseHandle(h_output_file);
+        return false;
+    }
+
+    CloseHandle(h_output_file);
+    return true;
+}
+
+// Leaves the file, and so its timestamp, untouched if it already holds
+// `contents`, so ninja's restat can prune work downstream of it
+bool WriteDiskFileIfChanged(const std::string& file_path, std::string_view contents) {
+    if (::GetFileAttributes(file_path.c_str()) != INVALID_FILE_ATTRIBUTES) {
+        std::vector<uint8_t> existing_contents;
+
+        if (ReadDiskFile(file_path, &existing_contents) &&
+            existing_contents.size() == contents.size() &&
+            memcmp(existing_contents.data(), contents.data(), contents.size()) == 0) {
+            return true;
+        }
+    }
+
+    return WriteDiskFile(file_path, contents);
+}
+
+std::string_view CodeFriendlyString(Arena& arena, std::string_view str) {
+    while (!str.empty() && !std::isalnum((unsigned char)str.front())) {
+        str.remove_prefix(1);
+    }
+
+    const bool needs_prefix = str.empty() || std::isdigit((unsigned char)str.front());
+
+    char* friendly = (char*)arena.Allocate(str.size() + needs_prefix, 1);
+    char* out = friendly;
+
+    if (needs_prefix) {
+        *out++ = '_';
+    }
+
+    for (char c : str) {
+        *out++ = std::isalnum((unsigned char)c) ? c : '_';
+    }
+
+    return { friendly, (size_t)(out - friendly) };
+}
+
+void AppendDiskPath(std::string* disk_path, std::string_view root_path, std::string_view path) {
+    disk_path->assign(root_path);
+    for (char c : path) {
+        disk_path->push_back(c == '/' ? '\\' : c);
+    }
+}
+
+std::string NormalizeDirectoryString(std::string string) {
+    if (string.empty()) return string;
+
+    for (auto& c : string) {
+        if (c == '/') c = '\\';
+    }
+
+    if (string.back() != '\\') {
+        string.push_back('\\');
+    }
+
+    return string;
+}
+
+constexpr std::string_view cpp_file_preamble = R"(// AUTOGENERATED
+
+#include <array>
+#include <cstdint>
+
+)";
+
+// With dev accessors, bin.h maps the files instead in DIR2SRC_DEV builds
+constexpr std::string_view cpp_file_dev_preamble = R"(// AUTOGENERATED
+
+#if !defined(DIR2SRC_DEV)
+
+#include <array>
+#include <cstdint>
+
+)";
+
+constexpr std::string_view cpp_file_dev_epilogue = "\n#endif\n";
+
+// Type of files embedded NUL-terminated, in <root>::dir2src
+constexpr std::string_view nul_terminated_array_source = R"(
+// The file's bytes and a NUL that size() doesn't count, so text passes to
+// C APIs without a copy
+template <size_t N>
+struct NulTerminatedArray : std::array<uint8_t, N> {
+    uint8_t terminator = 0;
+
+    const char* c_str() const {
+        if constexpr (N == 0) return (const char*)&terminator;
+        else return (const char*)this->data();
+    }
+
+    std::string_view view() const {
+        return { c_str(), N };
+    }
+};
+)";
+
+// Generated bin.h gains <root>::dir2src with lookups over every file
+// sorted by path, either from tables compiled into bin_index.cpp or from a
+// mapped pack. The lookups only need detail::FileCount(), PathAt() and
+// FileAt() from either, and never allocate.
+constexpr std::string_view index_header_types = R"(
+// Every file, sorted by path. Lookups take O(log n) plus the entries
+// visited and never allocate. Paths are relative to the embedded root and
+// separated by '/'.
+
+struct File {
+    std::string_view path;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+)";
+
+// With compression, between index_header_types and index_header_entry
+constexpr std::string_view index_header_compressed_file = R"(
+    // Compressed files have no data: read them through this with ReadAt(),
+    // Decode() or Decoded(). Null for the others.
+    const CompressedResource* compressed = nullptr;
+)";
+
+// After index_header_compressed_file, if any. Instrumented builds count
+// the access in Bytes() instead, see index_header_profiled_file.
+constexpr std::string_view index_header_file_bytes = R"(
+    // The file's bytes, the same as data. Instrumented builds count an
+    // access here, so read listed files through this to profile them.
+    const uint8_t* Bytes() const { return data; }
+)";
+
+// Listing a file hands it out without counting it: only taking its bytes
+// does, or finding it
+constexpr std::string_view index_header_profiled_file = R"(
+    // Its position in Files(), which its access counters are at
+    size_t index = 0;
+
+    // The file's bytes, the same as data, counting an access. Listed files
+    // whose data is read directly aren't profiled.
+    const uint8_t* Bytes() const {
+        detail::RecordAccess(index);
+        return data;
+    }
+)";
+
+constexpr std::string_view index_header_entry = R"(};
+
+struct DirectoryEntry {
+    std::string_view name;
+    bool is_directory = false;
+    File file; // files only
+};
+)";
+
+// Constant-initialized, so nothing runs at startup. Left open for one of
+// the FileAt() definitions below.
+constexpr std::string_view index_header_tables = R"(
+namespace detail {
+
+// Struct of arrays: path i is path_pool[path_offsets[i], path_offsets[i + 1])
+extern const std::array<uint32_t, file_count + 1> path_offsets;
+extern const uint8_t path_pool[];
+
+inline size_t FileCount() {
+    return file_count;
+}
+
+inline std::string_view PathAt(size_t idx) {
+    return { (const char*)path_pool + path_offsets[idx], path_offsets[idx + 1] - path_offsets[idx] };
+}
+)";
+
+// Both FileAt() definitions are left open for the File's remaining fields:
+// its CompressedResource with compression, its index with instrumentation
+constexpr std::string_view index_header_embedded_files = R"(
+extern const std::array<const uint8_t*, file_count> file_data;
+extern const std::array<size_t, file_count> file_sizes;
+)";
+
+// Compressed files point at their CompressedResource instead of their data
+constexpr std::string_view index_header_embedded_compressed_files = R"(
+extern const std::array<const uint8_t*, file_count> file_data;
+extern const std::array<size_t, file_count> file_sizes;
+extern const std::array<const CompressedResource*, file_count> file_compressed;
+)";
+
+constexpr std::string_view index_header_embedded_file_at = R"(
+inline File FileAt(size_t idx) {
+    return { PathAt(idx), file_data[idx], file_sizes[idx])";
+
+// Files are mapped as they're found, not when the index is. Dev builds read
+// compressed files as they are, so have no CompressedResource.
+constexpr std::string_view index_header_dev_files = R"(
+extern const std::array<const Resource*, file_count> file_resources;
+
+inline File FileAt(size_t idx) {
+    const Resource& resource = *file_resources[idx];
+    return { PathAt(idx), resource.data(), resource.size())";
+
+// Layout shared with PackWriter below, little-endian throughout
+constexpr std::string_view pack_header_runtime = R"(
+namespace detail {
+
+struct PackEntry {
+    uint64_t data_offset;
+    uint64_t size;
+    uint32_t path_offset;
+    uint32_t path_size;
+};
+
+struct PackView {
+    const uint8_t* base = nullptr;
+    size_t file_count = 0;
+    const PackEntry* entries = nullptr;
+    const char* paths = nullptr;
+};
+
+// Maps and checks the pack on first use; empty if it's missing or invalid
+const PackView& Pack();
+
+inline size_t FileCount() {
+    return Pack().file_count;
+}
+
+inline std::string_view PathAt(size_t idx) {
+    const PackEntry& entry = Pack().entries[idx];
+    return { Pack().paths + entry.path_offset, entry.path_size };
+}
+
+inline File FileAt(size_t idx) {
+    const PackEntry& entry = Pack().entries[idx];
+    return { PathAt(idx), Pack().base + entry.data_offset, (size_t)entry.size };
+}
+
+} // namespace detail
+
+// Pack mapped by the first lookup, from the path given when generated
+// ("bin.pack" in the working directory by default) unless set before then
+void SetPackPath(const char* path);
+
+// Whether the pack was found and valid; lookups find nothing otherwise
+inline bool PackLoaded() {
+    return detail::Pack().base != nullptr;
+}
+)";
+
+constexpr std::string_view index_header_lookups = R"(
+namespace detail {
+
+// Paths under `directory` compare equal, the rest sort around them
+inline int CompareToDirectory(std::string_view path, std::string_view directory) {
+    int prefix_order = path.substr(0, directory.size()).compare(directory);
+    if (prefix_order != 0) return prefix_order;
+
+    if (path.size() == directory.size()) return -1;
+    return (int)(unsigned char)path[directory.size()] - (int)'/';
+}
+
+// First index in [first, last) for which `is_before` is false
+template <typename Predicate>
+size_t PartitionPoint(size_t first, size_t last, Predicate is_before) {
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+
+        if (is_before(middle)) first = middle + 1;
+        else last = middle;
+    }
+
+    return first;
+}
+
+inline std::pair<size_t, size_t> DirectoryBounds(std::string_view directory, size_t first, size_t last) {
+    while (!directory.empty() && directory.back() == '/') directory.remove_suffix(1);
+    if (directory.empty()) return { first, last };
+
+    first = PartitionPoint(first, last, [&](size_t idx) { return CompareToDirectory(PathAt(idx), directory) < 0; });
+    last = PartitionPoint(first, last, [&](size_t idx) { return CompareToDirectory(PathAt(idx), directory) == 0; });
+
+    return { first, last };
+}
+
+} // namespace detail
+
+class FileRange {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = File;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = File;
+
+        explicit Iterator(size_t idx) : idx(idx) {}
+
+        File operator*() const { return detail::FileAt(idx); }
+        Iterator& operator++() { ++idx; return *this; }
+
+        bool operator==(const Iterator& other) const { return idx == other.idx; }
+        bool operator!=(const Iterator& other) const { return idx != other.idx; }
+
+    private:
+        size_t idx;
+    };
+
+    FileRange(size_t first, size_t last) : first(first), last(last) {}
+
+    Iterator begin() const { return Iterator(first); }
+    Iterator end() const { return Iterator(last); }
+
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+    File operator[](size_t idx) const { return detail::FileAt(first + idx); }
+
+private:
+    size_t first;
+    size_t last;
+};
+
+// Subdirectories are visited once each, skipping their files by bisection
+class DirectoryListing {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = DirectoryEntry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = DirectoryEntry;
+
+        Iterator(size_t idx, size_t last, size_t name_offset) : idx(idx), last(last), name_offset(name_offset) {}
+
+        DirectoryEntry operator*() const {
+            std::string_view name = detail::PathAt(idx).substr(name_offset);
+            size_t separator_idx = name.find('/');
+
+            if (separator_idx == std::string_view::npos) {
+                return { name, false, detail::FileAt(idx) };
+            }
+
+            return { name.substr(0, separator_idx), true, {} };
+        }
+
+        Iterator& operator++() {
+            std::string_view path = detail::PathAt(idx);
+            size_t separator_idx = path.find('/', name_offset);
+
+            if (separator_idx == std::string_view::npos) {
+                ++idx;
+            } else {
+                idx = detail::DirectoryBounds(path.substr(0, separator_idx), idx, last).second;
+            }
+
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const { return idx == other.idx; }
+        bool operator!=(const Iterator& other) const { return idx != other.idx; }
+
+    private:
+        size_t idx;
+        size_t last;
+        size_t name_offset;
+    };
+
+    DirectoryListing(size_t first, size_t last, size_t name_offset) : first(first), last(last), name_offset(name_offset) {}
+
+    Iterator begin() const { return Iterator(first, last, name_offset); }
+    Iterator end() const { return Iterator(last, last, name_offset); }
+
+    bool empty() const { return first == last; }
+
+private:
+    size_t first;
+    size_t last;
+    size_t name_offset;
+};
+)";
+
+// Follows index_header_lookups and one of the Find() definitions below
+constexpr std::string_view index_header_listings = R"(
+// Every file, in path order
+inline FileRange Files() {
+    return { 0, detail::FileCount() };
+}
+
+// Every file below `directory`, recursively, in path order
+inline FileRange FilesUnder(std::string_view directory) {
+    auto [first, last] = detail::DirectoryBounds(directory, 0, detail::FileCount());
+    return { first, last };
+}
+
+// Files and subdirectories directly in `directory`, in path order
+inline DirectoryListing ListDirectory(std::string_view directory) {
+    while (!directory.empty() && directory.back() == '/') directory.remove_suffix(1);
+
+    auto [first, last] = detail::DirectoryBounds(directory, 0, detail::FileCount());
+    return { first, last, directory.empty() ? 0 : directory.size() + 1 };
+}
+)";
+
+constexpr std::string_view index_header_find = R"(
+// The file at `path`, if there is one
+inline std::optional<File> Find(std::string_view path) {
+    const size_t file_count = detail::FileCount();
+    size_t idx = detail::PartitionPoint(0, file_count, [&](size_t i) { return detail::PathAt(i) < path; });
+
+    if (idx == file_count || detail::PathAt(idx) != path) return std::nullopt;
+    return detail::FileAt(idx);
+}
+)";
+
+// With instrumentation, after profile_header. Files found count as
+// accessed, but listings hand every file out, used or not, so files listed
+// count when their bytes are taken, see index_header_profiled_file.
+constexpr std::string_view index_header_profiled_find = R"(
+// The file at `path`, if there is one
+inline std::optional<File> Find(std::string_view path) {
+    const size_t file_count = detail::FileCount();
+    size_t idx = detail::PartitionPoint(0, file_count, [&](size_t i) { return detail::PathAt(i) < path; });
+
+    if (idx == file_count || detail::PathAt(idx) != path) return std::nullopt;
+
+    detail::RecordAccess(idx);
+    return detail::FileAt(idx);
+}
+)";
+
+// With --dev, bin.h declares these instead of the embedded std::arrays
+// when DIR2SRC_DEV is defined, mapping files straight from the source tree
+constexpr std::string_view dev_header_resource = R"(
+// Reads like the std::array the file is embedded as in release builds.
+// The file is mapped from the source tree on first use and stays mapped;
+// a missing file reads as empty. Files embedded NUL-terminated are read
+// into memory with their NUL instead.
+class Resource {
+public:
+    constexpr explicit Resource(std::string_view path, bool nul_terminated = false)
+        : path(path), nul_terminated(nul_terminated) {}
+
+    const uint8_t* data() const { return Get().data; }
+    size_t size() const { return Get().size; }
+    bool empty() const { return size() == 0; }
+
+    const uint8_t* begin() const { return data(); }
+    const uint8_t* end() const { return Get().data + Get().size; }
+
+    const uint8_t& operator[](size_t idx) const { return data()[idx]; }
+
+    const char* c_str() const { return (const char*)data(); }
+    std::string_view view() const { return { c_str(), size() }; }
+
+private:
+    struct Mapping {
+        const uint8_t* data;
+        size_t size;
+    };
+
+    const Mapping& Get() const {
+        const Mapping* current_mapping = mapping.load(std::memory_order_acquire);
+        return current_mapping ? *current_mapping : *Map();
+    }
+
+    // In bin_dev.cpp
+    const Mapping* Map() const;
+
+    std::string_view path;
+    bool nul_terminated = false;
+    mutable std::atomic<const Mapping*> mapping = nullptr;
+};
+)";
+
+// Defines Resource::Map() for dev_header_resource. Follows the opening of
+// <root>::dir2src and an anonymous namespace declaring source_root, and
+// map_file_source.
+constexpr std::string_view dev_source = R"(
+} // namespace
+
+const Resource::Mapping* Resource::Map() const {
+    std::string file_path = source_root;
+    file_path.append("/").append(path);
+
+    size_t size = 0;
+    const uint8_t* data = MapFile(file_path.c_str(), &size);
+
+    if (nul_terminated) {
+        uint8_t* text = new uint8_t[size + 1];
+        if (size > 0) memcpy(text, data, size);
+        text[size] = 0;
+
+        UnmapFile(data, size);
+        data = text;
+    }
+
+    // Racing threads map the file once each, the first to publish wins
+    const Mapping* new_mapping = new Mapping{ data, size };
+    const Mapping* expected = nullptr;
+
+    if (!mapping.compare_exchange_strong(expected, new_mapping, std::memory_order_acq_rel)) {
+        if (nul_terminated) {
+            delete[] data;
+        }
+        else {
+            UnmapFile(data, size);
+        }
+
+        delete new_mapping;
+        return expected;
+    }
+
+    return new_mapping;
+}
+)";
+
+// Stands in for the std::array a file would be embedded as, so code reads
+// the same against a pack
+constexpr std::string_view pack_header_resource = R"(
+// Reads like the std::array the file is embedded as in release builds.
+// Each access looks the file up, so take data() and size() once in loops.
+class Resource {
+public:
+    constexpr explicit Resource(std::string_view path) : path(path) {}
+
+    const uint8_t* data() const { return Get().data; }
+    size_t size() const { return Get().size; }
+    bool empty() const { return size() == 0; }
+
+    const uint8_t* begin() const { return data(); }
+    const uint8_t* end() const { File file = Get(); return file.data + file.size; }
+
+    const uint8_t& operator[](size_t idx) const { return data()[idx]; }
+
+    // The pack holds a NUL after each file embedded NUL-terminated, so only
+    // those pass on as C strings
+    const char* c_str() const { return (const char*)data(); }
+    std::string_view view() const { File file = Get(); return { (const char*)file.data, file.size }; }
+
+private:
+    File Get() const {
+        std::optional<File> file = Find(path);
+        return file ? *file : File{ path };
+    }
+
+    std::string_view path;
+};
+)";
+
+// Includes for map_file_source, for runtimes generated into sources
+constexpr std::string_view map_file_includes = R"(
+#include <cstring>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+)";
+
+// Read-only whole-file mappings for the generated runtimes. Empty files
+// can't be mapped and come back as null.
+constexpr std::string_view map_file_source = R"(
+const uint8_t* MapFile(const char* path, size_t* size) {
+#if defined(_WIN32)
+    HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+    LARGE_INTEGER file_size = {};
+    ::GetFileSizeEx(file, &file_size);
+
+    HANDLE mapping = ::CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    ::CloseHandle(file);
+    if (mapping == NULL) return nullptr;
+
+    // The view keeps the mapping alive
+    const void* view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    ::CloseHandle(mapping);
+
+    *size = (size_t)file_size.QuadPart;
+    return (const uint8_t*)view;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat file_stat = {};
+    if (::fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    void* view = ::mmap(nullptr, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) return nullptr;
+
+    *size = (size_t)file_stat.st_size;
+    return (const uint8_t*)view;
+#endif
+}
+
+void UnmapFile(const uint8_t* data, size_t size) {
+    if (data == nullptr) return;
+
+#if defined(_WIN32)
+    (void)size;
+    ::UnmapViewOfFile(data);
+#else
+    ::munmap((void*)data, size);
+#endif
+}
+)";
+
+// Maps the pack for the lookups in bin.h. Follows the opening of
+// <root>::dir2src and an anonymous namespace declaring pack_path, and
+// map_file_source.
+constexpr std::string_view pack_source = R"(
+struct PackHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t alignment;
+    uint64_t file_count;
+    uint64_t index_offset;
+    uint64_t path_pool_offset;
+    uint64_t path_pool_size;
+    uint64_t pack_size;
+};
+
+detail::PackView MapPack(const char* path) {
+    size_t size = 0;
+    const uint8_t* base = MapFile(path, &size);
+
+    if (base == nullptr || size < sizeof(PackHeader)) {
+        UnmapFile(base, size);
+        return {};
+    }
+
+    PackHeader header;
+    memcpy(&header, base, sizeof(header));
+
+    if (memcmp(header.magic, "dir2src", 8) != 0 || header.version != 1 || header.pack_size != size ||
+        header.index_offset > size || header.file_count > (size - header.index_offset) / sizeof(detail::PackEntry) ||
+        header.path_pool_offset > size || header.path_pool_size > size - header.path_pool_offset) {
+        UnmapFile(base, size);
+        return {};
+    }
+
+    const auto* entries = (const detail::PackEntry*)(base + header.index_offset);
+
+    for (size_t i = 0; i < header.file_count; ++i) {
+        if (entries[i].data_offset > size || entries[i].size > size - entries[i].data_offset ||
+            (uint64_t)entries[i].path_offset + entries[i].path_size > header.path_pool_size) {
+            UnmapFile(base, size);
+            return {};
+        }
+    }
+
+    return { base, (size_t)header.file_count, entries, (const char*)base + header.path_pool_offset };
+}
+
+} // namespace
+
+void SetPackPath(const char* path) {
+    pack_path = path;
+}
+
+const detail::PackView& detail::Pack() {
+    static const PackView pack = MapPack(pack_path);
+    return pack;
+}
+)";
+
+// Declared in bin.h when large files are page-aligned
+constexpr std::string_view release_header = R"(
+// Gives a resource's resident pages back to the kernel, once it's been
+// read for the last time; touching it again reads it back in. Only whole
+// pages within the resource are released, so neighbouring data is never
+// affected. Large files start on a page, but an embedded array's last
+// partial page stays resident. Not for arrays the program writes to.
+void Release(const void* data, size_t size);
+
+template <typename Resource>
+void Release(const Resource& resource) {
+    Release(resource.data(), resource.size());
+}
+)";
+
+// Declared in bin.h with page alignment of compressed files, after
+// compressed_header
+constexpr std::string_view compressed_release_header = R"(
+// Gives a compressed resource's chunks back the same way; what's been
+// inflated from them is the decoded cache's, see SetDecodedCacheBudget()
+void Release(const CompressedResource& resource);
+)";
+
+// Follows release_source
+constexpr std::string_view compressed_release_source = R"(
+void Release(const CompressedResource& resource) {
+    Release(resource.chunk_data, resource.chunk_offsets[resource.chunk_count]);
+}
+)";
+
+// Follows map_file_includes and the opening of <root>::dir2src
+constexpr std::string_view release_source = R"(
+void Release(const void* data, size_t size) {
+#if defined(_WIN32)
+    SYSTEM_INFO system_info;
+    ::GetSystemInfo(&system_info);
+    const uintptr_t page_size = system_info.dwPageSize;
+#else
+    const uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+#endif
+
+    const uintptr_t first = ((uintptr_t)data + page_size - 1) / page_size * page_size;
+    const uintptr_t last = ((uintptr_t)data + size) / page_size * page_size;
+    if (first >= last) return;
+
+#if defined(_WIN32)
+    // Unlocking pages that were never locked still trims them from the
+    // working set
+    ::VirtualUnlock((void*)first, last - first);
+#else
+    madvise((void*)first, last - first, MADV_DONTNEED);
+#endif
+}
+)";
+
+// Declared in bin.h with HTTP metadata
+constexpr std::string_view http_header = R"(
+// What an HTTP server sends with a file, worked out when generated. The
+// ETags are strong and quoted, ready for If-None-Match: etag goes with the
+// file as it is, gzip_etag with its <name>_gz, empty when it has none. A
+// strong ETag must differ between content codings. The modification time
+// is in Unix seconds and as an HTTP date, ready for Last-Modified.
+struct HttpMetadata {
+    std::string_view etag;
+    std::string_view content_type;
+    int64_t last_modified = 0;
+    std::string_view last_modified_date;
+    std::string_view gzip_etag;
+};
+)";
+
+// Type of compressed files, in <root>::dir2src
+constexpr std::string_view compressed_resource_source = R"(
+// A file compressed in chunks of chunk_size bytes, the last shorter, each
+// a raw DEFLATE stream of its own: chunk i is chunk_data from
+// chunk_offsets[i] to chunk_offsets[i + 1]. Any range can be read by
+// inflating only the chunks it touches.
+struct CompressedResource {
+    const uint8_t* chunk_data = nullptr;
+    const uint32_t* chunk_offsets = nullptr;
+    size_t chunk_count = 0;
+    size_t chunk_size = 0;
+    uint64_t uncompressed_size = 0;
+
+    // Its slot in the decoded cache, see Decoded()
+    size_t cache_idx = 0;
+
+    uint64_t size() const { return uncompressed_size; }
+    bool empty() const { return uncompressed_size == 0; }
+
+    // Inflated size of chunk idx
+    size_t ChunkSize(size_t idx) const {
+        return idx + 1 < chunk_count ? chunk_size : (size_t)(uncompressed_size - (uint64_t)idx * chunk_size);
+    }
+};
+)";
+
+// Declared in bin.h when files are compressed, after
+// compressed_resource_source
+constexpr std::string_view compressed_header = R"(
+// Inflates chunk idx into dst, which holds resource.ChunkSize(idx) bytes,
+// allocating nothing; for spreading chunks over threads of the caller's
+// own. Returns false if the chunk is corrupt.
+bool DecodeChunk(const CompressedResource& resource, size_t idx, void* dst);
+
+// Copies up to len bytes from offset on into dst, inflating only the
+// chunks the range touches, on the calling thread. With max_threads above
+// one, or zero for one per hardware thread, ranges over several chunks are
+// inflated on up to that many threads at once, started for the call: for
+// large reads, not random ones. Returns how many bytes were copied, fewer
+// only at the end of the resource, or none if a chunk is corrupt.
+size_t ReadAt(const CompressedResource& resource, uint64_t offset, void* dst, size_t len, size_t max_threads = 1);
+
+// The same for files held as they are, e.g. in dev builds, so code reads
+// compressed and uncompressed files alike
+template <typename Resource>
+size_t ReadAt(const Resource& resource, uint64_t offset, void* dst, size_t len, size_t = 1) {
+    if (offset >= resource.size()) return 0;
+
+    const size_t copied = resource.size() - offset < len ? (size_t)(resource.size() - offset) : len;
+    memcpy(dst, resource.data() + offset, copied);
+    return copied;
+}
+
+// Inflates the whole resource into dst, which holds resource.size() bytes,
+// on the calling thread and allocating nothing. Returns false if a chunk
+// is corrupt.
+bool Decode(const CompressedResource& resource, void* dst);
+
+namespace detail {
+struct CacheSlot;
+void Unpin(CacheSlot* slot);
+}
+
+// A resource's inflated bytes, shared through the decoded cache. They stay
+// valid, and cached, for as long as a handle to them lives. data() is null
+// if the resource is corrupt.
+class DecodedResource {
+public:
+    DecodedResource() = default;
+    DecodedResource(const uint8_t* bytes, size_t byte_count, detail::CacheSlot* slot = nullptr)
+        : bytes(bytes), byte_count(byte_count), slot(slot) {}
+
+    DecodedResource(DecodedResource&& other) noexcept
+        : bytes(other.bytes), byte_count(other.byte_count), slot(other.slot) {
+        other.slot = nullptr;
+    }
+
+    DecodedResource& operator=(DecodedResource&& other) noexcept {
+        if (this != &other) {
+            if (slot != nullptr) detail::Unpin(slot);
+
+            bytes = other.bytes;
+            byte_count = other.byte_count;
+            slot = other.slot;
+            other.slot = nullptr;
+        }
+        return *this;
+    }
+
+    DecodedResource(const DecodedResource&) = delete;
+    DecodedResource& operator=(const DecodedResource&) = delete;
+
+    ~DecodedResource() {
+        if (slot != nullptr) detail::Unpin(slot);
+    }
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return byte_count; }
+    bool empty() const { return byte_count == 0; }
+    const uint8_t* begin() const { return bytes; }
+    const uint8_t* end() const { return bytes + byte_count; }
+    uint8_t operator[](size_t idx) const { return bytes[idx]; }
+
+private:
+    const uint8_t* bytes = nullptr;
+    size_t byte_count = 0;
+    detail::CacheSlot* slot = nullptr;
+};
+
+// The resource's inflated bytes from the process-wide decoded cache. The
+// first reader inflates them, concurrent first readers wait for it rather
+// than inflating them again. Finding cached bytes takes no lock and
+// allocates nothing: each compressed file has a slot of its own. Once the
+// cache holds more than its budget, resources no handle holds are evicted,
+// least recently used first to the nearest miss.
+DecodedResource Decoded(const CompressedResource& resource);
+
+// How many inflated bytes the decoded cache keeps, 64 MiB unless set.
+// Lowering it evicts at once; resources in use are kept over budget until
+// their last handle goes.
+void SetDecodedCacheBudget(size_t bytes);
+
+// The same for files held as they are
+template <typename Resource>
+bool Decode(const Resource& resource, void* dst) {
+    if (!resource.empty()) memcpy(dst, resource.data(), resource.size());
+    return true;
+}
+
+template <typename Resource>
+DecodedResource Decoded(const Resource& resource) {
+    return { resource.data(), resource.size() };
+}
+)";
+
+constexpr std::string_view compressed_includes = R"(
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+)";
+
+// Access profiling hooks for compressed_source, compiled away unless
+// instrumented
+constexpr std::string_view compressed_unprofiled_hooks = R"(
+namespace {
+
+void RecordAccess(const CompressedResource&) {}
+
+uint64_t ProfileClock() {
+    return 0;
+}
+
+void RecordDecodeTime(const CompressedResource&, uint64_t) {}
+
+} // namespace
+)";
+
+// Counted against each file's position in the index, which bin_profile.cpp
+// maps cache slots to
+constexpr std::string_view compressed_profiled_hooks = R"(
+namespace detail {
+extern const uint32_t compressed_file_indices[];
+}
+
+namespace {
+
+void RecordAccess(const CompressedResource& resource) {
+    detail::RecordAccess(detail::compressed_file_indices[resource.cache_idx]);
+}
+
+uint64_t ProfileClock() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RecordDecodeTime(const CompressedResource& resource, uint64_t started) {
+    auto& counters = detail::access_counters[detail::compressed_file_indices[resource.cache_idx]];
+    counters.decode_time.fetch_add(ProfileClock() - started, std::memory_order_relaxed);
+}
+
+} // namespace
+)";
+
+// Follows compressed_includes, the opening of <root>::dir2src and one of
+// the hooks above
+constexpr std::string_view compressed_source = R"(
+namespace {
+
+// Codes of up to this many bits are decoded in one lookup, longer ones a
+// bit at a time
+constexpr unsigned fast_bits = 10;
+
+// Reads over several chunks start a thread per this many
+constexpr size_t chunks_per_thread = 2;
+
+constexpr uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+constexpr uint8_t length_extra_bits[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+constexpr uint16_t distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577,
+};
+constexpr uint8_t distance_extra_bits[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+constexpr uint8_t code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : next(data), end(data + size) {}
+
+    // Tops the buffer up to at least 57 bits, enough for any match
+    void Refill() {
+        for (; count <= 56; count += 8) {
+            if (next < end) bits |= (uint64_t)*next++ << count;
+            else ++padding;
+        }
+    }
+
+    uint32_t Take(unsigned n) {
+        const uint32_t value = (uint32_t)(bits & ((1ull << n) - 1));
+        bits >>= n;
+        count -= n;
+        return value;
+    }
+
+    uint32_t Peek(unsigned n) const {
+        return (uint32_t)(bits & ((1ull << n) - 1));
+    }
+
+    // Stored blocks are copied from the input as they are, after dropping
+    // to a byte boundary and giving back the whole bytes buffered
+    const uint8_t* AlignToByte() {
+        Take(count % 8);
+
+        if (padding * 8 > count) return nullptr;
+
+        next -= count / 8 - padding;
+        bits = 0;
+        count = 0;
+        padding = 0;
+        return next;
+    }
+
+    void Skip(size_t size) {
+        next += size;
+    }
+
+    size_t Remaining() const {
+        return (size_t)(end - next);
+    }
+
+    // Whether zeros fed in past the end have been consumed, so the stream
+    // was cut short
+    bool Overrun() const {
+        return padding * 8 > count;
+    }
+
+private:
+    const uint8_t* next;
+    const uint8_t* end;
+    uint64_t bits = 0;
+    unsigned count = 0;
+    unsigned padding = 0;
+};
+
+// Canonical code, by length then symbol. Fast entries are indexed by the
+// next fast_bits bits and hold (symbol << 4) | length, or zero for longer
+// codes.
+struct Huffman {
+    uint16_t fast[1 << fast_bits];
+    uint16_t counts[16];
+    uint16_t symbols[288];
+};
+
+// Incomplete codes are allowed, as for a lone distance code, but not
+// oversubscribed ones
+bool BuildHuffman(Huffman* huffman, const uint8_t* lengths, size_t count) {
+    memset(huffman->counts, 0, sizeof(huffman->counts));
+
+    for (size_t i = 0; i < count; ++i) {
+        ++huffman->counts[lengths[i]];
+    }
+
+    huffman->counts[0] = 0;
+
+    int left = 1;
+    for (int length = 1; length < 16; ++length) {
+        left = (left << 1) - huffman->counts[length];
+        if (left < 0) return false;
+    }
+
+    uint16_t offsets[16] = {};
+    for (int length = 1; length < 15; ++length) {
+        offsets[length + 1] = offsets[length] + huffman->counts[length];
+    }
+
+    for (size_t symbol = 0; symbol < count; ++symbol) {
+        if (lengths[symbol] != 0) huffman->symbols[offsets[lengths[symbol]]++] = (uint16_t)symbol;
+    }
+
+    memset(huffman->fast, 0, sizeof(huffman->fast));
+
+    // Codes are read first bit first, so the table is indexed by them reversed
+    uint32_t code = 0;
+    size_t symbol_idx = 0;
+
+    for (unsigned length = 1; length <= fast_bits; ++length, code <<= 1) {
+        for (uint16_t i = 0; i < huffman->counts[length]; ++i, ++code, ++symbol_idx) {
+            uint32_t reversed = 0;
+            for (unsigned bit = 0; bit < length; ++bit) {
+                reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+            }
+
+            for (uint32_t fill = reversed; fill < (1u << fast_bits); fill += 1u << length) {
+                huffman->fast[fill] = (uint16_t)(huffman->symbols[symbol_idx] << 4 | length);
+            }
+        }
+    }
+
+    return true;
+}
+
+// After a Refill(). Returns -1 for a code that isn't in the table.
+int DecodeSymbol(BitReader& reader, const Huffman& huffman) {
+    const uint16_t entry = huffman.fast[reader.Peek(fast_bits)];
+
+    if (entry != 0) {
+        reader.Take(entry & 15);
+        return entry >> 4;
+    }
+
+    int code = 0;
+    int first = 0;
+    int symbol_idx = 0;
+
+    for (int length = 1; length < 16; ++length) {
+        code |= (int)reader.Take(1);
+
+        const int count = huffman.counts[length];
+        if (code - first < count) return huffman.symbols[symbol_idx + code - first];
+
+        symbol_idx += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+struct FixedCodes {
+    Huffman literal_lengths;
+    Huffman distances;
+};
+
+const FixedCodes& GetFixedCodes() {
+    static const FixedCodes codes = [] {
+        FixedCodes c;
+        uint8_t lengths[288];
+
+        memset(lengths, 8, 144);
+        memset(lengths + 144, 9, 112);
+        memset(lengths + 256, 7, 24);
+        memset(lengths + 280, 8, 8);
+        BuildHuffman(&c.literal_lengths, lengths, 288);
+
+        memset(lengths, 5, 30);
+        BuildHuffman(&c.distances, lengths, 30);
+
+        return c;
+    }();
+
+    return codes;
+}
+
+bool ReadDynamicCodes(BitReader& reader, Huffman* literal_lengths, Huffman* distances) {
+    const size_t literal_length_count = reader.Take(5) + 257;
+    const size_t distance_count = reader.Take(5) + 1;
+    const size_t code_length_count = reader.Take(4) + 4;
+
+    if (literal_length_count > 286 || distance_count > 30) return false;
+
+    uint8_t code_length_lengths[19] = {};
+
+    for (size_t i = 0; i < code_length_count; ++i) {
+        reader.Refill();
+        code_length_lengths[code_length_order[i]] = (uint8_t)reader.Take(3);
+    }
+
+    Huffman code_lengths;
+    if (!BuildHuffman(&code_lengths, code_length_lengths, 19)) return false;
+
+    uint8_t lengths[286 + 30] = {};
+    const size_t length_count = literal_length_count + distance_count;
+
+    for (size_t i = 0; i < length_count;) {
+        reader.Refill();
+
+        const int symbol = DecodeSymbol(reader, code_lengths);
+        if (symbol < 0) return false;
+
+        if (symbol < 16) {
+            lengths[i++] = (uint8_t)symbol;
+            continue;
+        }
+
+        uint8_t repeated = 0;
+        size_t repeat_count = 0;
+
+        if (symbol == 16) {
+            if (i == 0) return false;
+            repeated = lengths[i - 1];
+            repeat_count = 3 + reader.Take(2);
+        }
+        else if (symbol == 17) {
+            repeat_count = 3 + reader.Take(3);
+        }
+        else {
+            repeat_count = 11 + reader.Take(7);
+        }
+
+        if (i + repeat_count > length_count) return false;
+
+        for (; repeat_count > 0; --repeat_count) {
+            lengths[i++] = repeated;
+        }
+    }
+
+    // Every block ends with the end-of-block code
+    if (lengths[256] == 0) return false;
+
+    return BuildHuffman(literal_lengths, lengths, literal_length_count) &&
+           BuildHuffman(distances, lengths + literal_length_count, distance_count);
+}
+
+// Inflates the raw DEFLATE stream into out until out_size bytes are
+// written, which may be before the stream ends
+bool Inflate(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_size) {
+    BitReader reader(in, in_size);
+    size_t produced = 0;
+    bool final_block = false;
+
+    while (!final_block && produced < out_size) {
+        reader.Refill();
+        if (reader.Overrun()) return false;
+
+        final_block = reader.Take(1) != 0;
+        const uint32_t type = reader.Take(2);
+
+        if (type == 0) {
+            const uint8_t* stored = reader.AlignToByte();
+            if (stored == nullptr || reader.Remaining() < 4) return false;
+
+            const size_t size = stored[0] | stored[1] << 8;
+            const size_t complement = stored[2] | stored[3] << 8;
+            if (size != (~complement & 0xFFFF) || reader.Remaining() - 4 < size) return false;
+
+            const size_t copied = std::min(size, out_size - produced);
+            memcpy(out + produced, stored + 4, copied);
+            produced += copied;
+
+            reader.Skip(4 + size);
+            continue;
+        }
+
+        Huffman dynamic_literal_lengths;
+        Huffman dynamic_distances;
+
+        const Huffman* literal_lengths = &GetFixedCodes().literal_lengths;
+        const Huffman* distances = &GetFixedCodes().distances;
+
+        if (type == 2) {
+            if (!ReadDynamicCodes(reader, &dynamic_literal_lengths, &dynamic_distances)) return false;
+
+            literal_lengths = &dynamic_literal_lengths;
+            distances = &dynamic_distances;
+        }
+        else if (type != 1) {
+            return false;
+        }
+
+        for (;;) {
+            reader.Refill();
+
+            int symbol = DecodeSymbol(reader, *literal_lengths);
+
+            if (symbol < 256) {
+                if (symbol < 0) return false;
+
+                out[produced++] = (uint8_t)symbol;
+                if (produced == out_size) return !reader.Overrun();
+                continue;
+            }
+
+            if (symbol == 256) break;
+
+            symbol -= 257;
+            if (symbol >= 29) return false;
+
+            size_t length = length_base[symbol] + reader.Take(length_extra_bits[symbol]);
+
+            const int distance_symbol = DecodeSymbol(reader, *distances);
+            if (distance_symbol < 0 || distance_symbol >= 30) return false;
+
+            const size_t distance = distance_base[distance_symbol] + reader.Take(distance_extra_bits[distance_symbol]);
+            if (distance > produced) return false;
+
+            length = std::min(length, out_size - produced);
+
+            const uint8_t* from = out + produced - distance;
+            uint8_t* to = out + produced;
+
+            // Overlapping copies repeat the bytes just written
+            if (distance >= length) {
+                memcpy(to, from, length);
+            }
+            else {
+                for (size_t i = 0; i < length; ++i) to[i] = from[i];
+            }
+
+            produced += length;
+            if (produced == out_size) return !reader.Overrun();
+        }
+    }
+
+    return produced == out_size && !reader.Overrun();
+}
+
+// The first out_size bytes of chunk idx
+bool InflateChunk(const CompressedResource& resource, size_t idx, uint8_t* out, size_t out_size) {
+    const uint64_t started = ProfileClock();
+
+    const uint32_t chunk_offset = resource.chunk_offsets[idx];
+    const bool inflated = Inflate(resource.chunk_data + chunk_offset, resource.chunk_offsets[idx + 1] - chunk_offset, out, out_size);
+
+    RecordDecodeTime(resource, started);
+    return inflated;
+}
+
+bool InflateAll(const CompressedResource& resource, uint8_t* out) {
+    for (size_t idx = 0; idx < resource.chunk_count; ++idx) {
+        if (!InflateChunk(resource, idx, out + (uint64_t)idx * resource.chunk_size, resource.ChunkSize(idx))) return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+bool DecodeChunk(const CompressedResource& resource, size_t idx, void* dst) {
+    RecordAccess(resource);
+    return idx < resource.chunk_count && InflateChunk(resource, idx, (uint8_t*)dst, resource.ChunkSize(idx));
+}
+
+size_t ReadAt(const CompressedResource& resource, uint64_t offset, void* dst, size_t len, size_t max_threads) {
+    RecordAccess(resource);
+    if (offset >= resource.size()) return 0;
+
+    len = (size_t)std::min<uint64_t>(len, resource.size() - offset);
+
+    uint8_t* out = (uint8_t*)dst;
+    const uint64_t range_end = offset + len;
+
+    size_t first_idx = (size_t)(offset / resource.chunk_size);
+    const size_t end_idx = (size_t)((range_end + resource.chunk_size - 1) / resource.chunk_size);
+
+    // A range starting inside a chunk needs the chunk inflated from its
+    // start, into scratch kept by the thread
+    const size_t skip = (size_t)(offset % resource.chunk_size);
+
+    if (skip != 0) {
+        const size_t inflated_size = (size_t)std::min<uint64_t>(resource.chunk_size, skip + len);
+
+        thread_local std::vector<uint8_t> scratch;
+        if (scratch.size() < inflated_size) scratch.resize(inflated_size);
+
+        if (!InflateChunk(resource, first_idx, scratch.data(), inflated_size)) return 0;
+
+        memcpy(out, scratch.data() + skip, inflated_size - skip);
+        ++first_idx;
+    }
+
+    // The rest start on a chunk, so each is inflated straight into dst, the
+    // last only as far as the range goes
+    std::atomic<size_t> next_idx{ first_idx };
+    std::atomic<bool> success{ true };
+
+    auto inflate_chunks = [&] {
+        for (size_t idx = next_idx++; idx < end_idx; idx = next_idx++) {
+            const uint64_t chunk_offset = (uint64_t)idx * resource.chunk_size;
+            const size_t size = (size_t)std::min<uint64_t>(resource.chunk_size, range_end - chunk_offset);
+
+            if (!InflateChunk(resource, idx, out + (chunk_offset - offset), size)) {
+                success = false;
+            }
+        }
+    };
+
+    const size_t thread_count = std::min<size_t>(
+        max_threads != 0 ? max_threads : std::max(std::thread::hardware_concurrency(), 1u),
+        std::max<size_t>((end_idx - first_idx) / chunks_per_thread, 1));
+
+    std::vector<std::thread> threads;
+
+    // Chunks are taken as threads get to them, so those that can't be
+    // started leave theirs to the rest
+    try {
+        for (size_t i = 1; i < thread_count; ++i) {
+            threads.emplace_back(inflate_chunks);
+        }
+    }
+    catch (...) {
+    }
+
+    inflate_chunks();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return success ? len : 0;
+}
+
+bool Decode(const CompressedResource& resource, void* dst) {
+    RecordAccess(resource);
+    return InflateAll(resource, (uint8_t*)dst);
+}
+
+namespace detail {
+
+// A cache line each, so readers of different resources don't contend
+struct alignas(64) CacheSlot {
+    std::atomic<uint32_t> state{ 0 };
+    std::atomic<uint32_t> pins{ 0 };
+    std::atomic<uint64_t> last_used{ 0 };
+
+    // Set before the slot turns ready, freed once it's claimed for eviction
+    uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+} // namespace detail
+
+namespace {
+
+enum : uint32_t {
+    slot_empty,
+    slot_inflating,
+    slot_ready,
+    slot_evicting,
+};
+
+detail::CacheSlot cache_slots[compressed_file_count > 0 ? compressed_file_count : 1];
+
+// Advanced by each miss, so hits only read it
+std::atomic<uint64_t> cache_clock{ 1 };
+
+std::atomic<size_t> cached_bytes{ 0 };
+std::atomic<size_t> cache_budget{ (size_t)64 << 20 };
+
+// Only taken on misses: by readers waiting for a slot being inflated, and
+// by the one thread evicting at a time
+std::mutex inflated_mutex;
+std::condition_variable inflated;
+std::mutex eviction_mutex;
+
+// Leaving slot_inflating wakes the readers waiting on the slot
+void FinishInflating(detail::CacheSlot& slot, uint32_t state) {
+    {
+        std::lock_guard lock(inflated_mutex);
+        slot.state = state;
+    }
+
+    inflated.notify_all();
+}
+
+// Scans every slot for the least recently used one no handle holds, which
+// only misses and releases over budget pay for
+void EvictOverBudget() {
+    std::lock_guard lock(eviction_mutex);
+
+    while (cached_bytes > cache_budget) {
+        detail::CacheSlot* victim = nullptr;
+        uint64_t victim_last_used = UINT64_MAX;
+
+        for (auto& slot : cache_slots) {
+            if (slot.state.load(std::memory_order_relaxed) == slot_ready && slot.pins.load(std::memory_order_relaxed) == 0 &&
+                slot.last_used.load(std::memory_order_relaxed) < victim_last_used) {
+                victim = &slot;
+                victim_last_used = slot.last_used.load(std::memory_order_relaxed);
+            }
+        }
+
+        if (victim == nullptr) return;
+
+        // Readers pin a slot before checking it's ready, and this claims it
+        // before checking it's unpinned, so one of the two sees the other
+        uint32_t expected = slot_ready;
+        if (!victim->state.compare_exchange_strong(expected, slot_evicting)) continue;
+
+        if (victim->pins != 0) {
+            victim->state = slot_ready;
+            continue;
+        }
+
+        free(victim->data);
+        victim->data = nullptr;
+        cached_bytes -= victim->size;
+        victim->state = slot_empty;
+    }
+}
+
+} // namespace
+
+void detail::Unpin(CacheSlot* slot) {
+    slot->pins.fetch_sub(1);
+
+    if (cached_bytes > cache_budget) EvictOverBudget();
+}
+
+DecodedResource Decoded(const CompressedResource& resource) {
+    RecordAccess(resource);
+
+    detail::CacheSlot& slot = cache_slots[resource.cache_idx];
+    slot.pins.fetch_add(1);
+
+    for (;;) {
+        uint32_t state = slot.state;
+
+        if (state == slot_ready) {
+            // Only written when it changes, so readers of a hot resource
+            // don't take its cache line from each other
+            const uint64_t now = cache_clock.load(std::memory_order_relaxed);
+            if (slot.last_used.load(std::memory_order_relaxed) != now) slot.last_used.store(now, std::memory_order_relaxed);
+
+            return { slot.data, slot.size, &slot };
+        }
+
+        if (state == slot_empty && slot.state.compare_exchange_strong(state, slot_inflating)) {
+            const size_t size = (size_t)resource.size();
+            uint8_t* data = (uint8_t*)malloc(size > 0 ? size : 1);
+
+            if (data == nullptr || !InflateAll(resource, data)) {
+                free(data);
+                FinishInflating(slot, slot_empty);
+                slot.pins.fetch_sub(1);
+                return {};
+            }
+
+            slot.data = data;
+            slot.size = size;
+            slot.last_used.store(cache_clock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            cached_bytes += size;
+            FinishInflating(slot, slot_ready);
+
+            // Pinned, so this never evicts what it returns
+            if (cached_bytes > cache_budget) EvictOverBudget();
+
+            return { data, size, &slot };
+        }
+
+        if (state == slot_inflating) {
+            std::unique_lock lock(inflated_mutex);
+            inflated.wait(lock, [&] { return slot.state != slot_inflating; });
+        }
+        else if (state == slot_evicting) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void SetDecodedCacheBudget(size_t bytes) {
+    cache_budget = bytes;
+
+    if (cached_bytes > bytes) EvictOverBudget();
+}
+)";
+
+// Declared in bin.h with instrumentation, before the index
+constexpr std::string_view profile_header = R"(
+namespace detail {
+
+// One per file in index order, each on a cache line of its own so threads
+// counting different files don't contend. Updated relaxed: they're only
+// statistics.
+struct alignas(64) AccessCounters {
+    std::atomic<uint64_t> accesses{ 0 };
+
+    // Steady clock nanoseconds, zero until accessed
+    std::atomic<uint64_t> first_access{ 0 };
+
+    // Nanoseconds spent inflating the file, over all threads
+    std::atomic<uint64_t> decode_time{ 0 };
+};
+
+extern AccessCounters access_counters[];
+
+void RecordFirstAccess(size_t idx);
+
+inline void RecordAccess(size_t idx) {
+    if (access_counters[idx].accesses.fetch_add(1, std::memory_order_relaxed) == 0) RecordFirstAccess(idx);
+}
+
+} // namespace detail
+
+// Reads like the std::array or Resource it wraps, counting an access each
+// time its bytes are taken, though not its size. bin.h declares each file
+// that isn't compressed as one over <name>_bytes, so files read through
+// their own names are profiled too. Every access is an atomic add: take
+// data() once in loops.
+template <typename Array>
+class ProfiledResource {
+public:
+    constexpr ProfiledResource(const Array& array, size_t index) : array(array), index(index) {}
+
+    const uint8_t* data() const {
+        detail::RecordAccess(index);
+        return array.data();
+    }
+
+    size_t size() const { return array.size(); }
+    bool empty() const { return array.size() == 0; }
+
+    const uint8_t* begin() const { return data(); }
+    const uint8_t* end() const { return array.data() + array.size(); }
+    const uint8_t& operator[](size_t idx) const { return data()[idx]; }
+
+    // NUL-terminated files only
+    const char* c_str() const {
+        detail::RecordAccess(index);
+        return array.c_str();
+    }
+
+    std::string_view view() const { return { c_str(), size() }; }
+
+private:
+    const Array& array;
+    size_t index;
+};
+
+// Writes the files accessed so far to path, one per line in the order they
+// were first accessed: the path, then its access count, microseconds from
+// the first file's first access to its own and microseconds spent
+// inflating it, separated by tabs. Files never accessed are left out.
+// Given back to dir2src as the layout profile, the files are laid out in
+// that order, and with --prune-unprofiled the rest are left out, including
+// listed files only read through File::data. Returns false if the profile
+// couldn't be written.
+bool WriteAccessProfile(const char* path);
+)";
+
+constexpr std::string_view profile_includes = R"(
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+)";
+
+// Follows profile_includes and the opening of <root>::dir2src
+constexpr std::string_view profile_source = R"(
+void detail::RecordFirstAccess(size_t idx) {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    const uint64_t nanoseconds = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
+    access_counters[idx].first_access.store(std::max<uint64_t>(nanoseconds, 1), std::memory_order_relaxed);
+}
+
+bool WriteAccessProfile(const char* path) {
+    auto first_access_of = [](size_t idx) {
+        return detail::access_counters[idx].first_access.load(std::memory_order_relaxed);
+    };
+
+    // Files counted by a thread that hasn't stored the time yet wait for
+    // the next profile
+    std::vector<size_t> accessed;
+
+    for (size_t idx = 0; idx < file_count; ++idx) {
+        if (first_access_of(idx) != 0) accessed.push_back(idx);
+    }
+
+    std::stable_sort(accessed.begin(), accessed.end(), [&](size_t a, size_t b) {
+        return first_access_of(a) < first_access_of(b);
+    });
+
+    FILE* file = nullptr;
+#if defined(_WIN32)
+    if (fopen_s(&file, path, "wb") != 0) return false;
+#else
+    file = fopen(path, "wb");
+    if (file == nullptr) return false;
+#endif
+
+    fputs("# path\taccesses\tfirst access (us)\tinflating (us)\n", file);
+
+    const uint64_t start = accessed.empty() ? 0 : first_access_of(accessed.front());
+
+    for (size_t idx : accessed) {
+        const auto& counters = detail::access_counters[idx];
+        const std::string_view file_path = detail::PathAt(idx);
+
+        fwrite(file_path.data(), 1, file_path.size(), file);
+        fprintf(file, "\t%llu\t%llu\t%llu\n",
+                (unsigned long long)counters.accesses.load(std::memory_order_relaxed),
+                (unsigned long long)((first_access_of(idx) - start) / 1000),
+                (unsigned long long)(counters.decode_time.load(std::memory_order_relaxed) / 1000));
+    }
+
+    const bool written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
+)";
+
+// Declared in bin.h with checksums
+constexpr std::string_view checksum_header = R"(
+// CRC-32C (Castagnoli) of the bytes, as each file's <name>_crc32c was
+// computed when generated. Uses the SSE4.2 or ARMv8 CRC instructions
+// where available, several gigabytes a second.
+uint32_t Crc32c(const void* data, size_t size);
+
+// Whether a resource still holds the bytes it was generated from, e.g.
+// Verify(level_bin, level_bin_crc32c)
+template <typename Resource>
+bool Verify(const Resource& resource, uint32_t crc32c) {
+    return Crc32c(resource.data(), resource.size()) == crc32c;
+}
+)";
+
+constexpr std::string_view checksum_includes = R"(
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#define DIR2SRC_CRC32C_SSE42
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define DIR2SRC_CRC32C_ARM
+#endif
+)";
+
+// The same CRC as crc32c.cpp. Follows checksum_includes and the opening
+// of <root>::dir2src.
+constexpr std::string_view checksum_source = R"(
+namespace {
+
+constexpr uint32_t crc32c_polynomial = 0x82F63B78;
+
+// Three blocks are hashed at once, then combined by shifting the first
+// two over the bytes after them
+constexpr size_t long_block_size = 8192;
+constexpr size_t short_block_size = 256;
+
+uint32_t MatrixTimes(const uint32_t* matrix, uint32_t vector) {
+    uint32_t sum = 0;
+
+    for (; vector != 0; vector >>= 1, ++matrix) {
+        if (vector & 1) sum ^= *matrix;
+    }
+
+    return sum;
+}
+
+void MatrixSquare(uint32_t* square, const uint32_t* matrix) {
+    for (int n = 0; n < 32; ++n) {
+        square[n] = MatrixTimes(matrix, matrix[n]);
+    }
+}
+
+// Feeding `size` zero bytes through the register, for a power of two size
+void ZerosOperator(uint32_t* even, size_t size) {
+    uint32_t odd[32];
+
+    odd[0] = crc32c_polynomial;
+    for (int n = 1; n < 32; ++n) {
+        odd[n] = 1u << (n - 1);
+    }
+
+    MatrixSquare(even, odd);
+    MatrixSquare(odd, even);
+
+    for (;;) {
+        MatrixSquare(even, odd);
+        size >>= 1;
+        if (size == 0) return;
+
+        MatrixSquare(odd, even);
+        size >>= 1;
+        if (size == 0) break;
+    }
+
+    memcpy(even, odd, sizeof(odd));
+}
+
+struct Crc32cTables {
+    uint32_t bytes[8][256];
+    uint32_t long_shift[4][256];
+    uint32_t short_shift[4][256];
+};
+
+void FillShiftTable(uint32_t (*shift)[256], size_t size) {
+    uint32_t op[32];
+    ZerosOperator(op, size);
+
+    for (uint32_t n = 0; n < 256; ++n) {
+        shift[0][n] = MatrixTimes(op, n);
+        shift[1][n] = MatrixTimes(op, n << 8);
+        shift[2][n] = MatrixTimes(op, n << 16);
+        shift[3][n] = MatrixTimes(op, n << 24);
+    }
+}
+
+const Crc32cTables& GetCrc32cTables() {
+    static const Crc32cTables tables = [] {
+        Crc32cTables t = {};
+
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t crc = n;
+            for (int k = 0; k < 8; ++k) {
+                crc = crc & 1 ? (crc >> 1) ^ crc32c_polynomial : crc >> 1;
+            }
+            t.bytes[0][n] = crc;
+        }
+
+        for (uint32_t n = 0; n < 256; ++n) {
+            for (int k = 1; k < 8; ++k) {
+                t.bytes[k][n] = (t.bytes[k - 1][n] >> 8) ^ t.bytes[0][t.bytes[k - 1][n] & 0xFF];
+            }
+        }
+
+        FillShiftTable(t.long_shift, long_block_size);
+        FillShiftTable(t.short_shift, short_block_size);
+
+        return t;
+    }();
+
+    return tables;
+}
+
+uint32_t Crc32cPortable(uint32_t crc, const uint8_t* data, size_t size) {
+    const auto& bytes = GetCrc32cTables().bytes;
+
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low, high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc;
+
+        crc = bytes[7][low & 0xFF] ^ bytes[6][(low >> 8) & 0xFF] ^ bytes[5][(low >> 16) & 0xFF] ^ bytes[4][low >> 24] ^
+              bytes[3][high & 0xFF] ^ bytes[2][(high >> 8) & 0xFF] ^ bytes[1][(high >> 16) & 0xFF] ^ bytes[0][high >> 24];
+    }
+
+    for (; size > 0; ++data, --size) {
+        crc = (crc >> 8) ^ bytes[0][(crc ^ *data) & 0xFF];
+    }
+
+    return crc;
+}
+
+#if defined(DIR2SRC_CRC32C_SSE42) || defined(DIR2SRC_CRC32C_ARM)
+
+#if defined(DIR2SRC_CRC32C_SSE42)
+#define DIR2SRC_CRC32C_WORD(crc, word) (uint32_t)_mm_crc32_u64(crc, word)
+#define DIR2SRC_CRC32C_BYTE(crc, byte) _mm_crc32_u8(crc, byte)
+
+bool HasCrc32cInstruction() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+#else
+#define DIR2SRC_CRC32C_WORD(crc, word) __crc32cd(crc, word)
+#define DIR2SRC_CRC32C_BYTE(crc, byte) __crc32cb(crc, byte)
+
+bool HasCrc32cInstruction() {
+    return true;
+}
+#endif
+
+uint32_t Shift(const uint32_t (*shift)[256], uint32_t crc) {
+    return shift[0][crc & 0xFF] ^ shift[1][(crc >> 8) & 0xFF] ^ shift[2][(crc >> 16) & 0xFF] ^ shift[3][crc >> 24];
+}
+
+uint64_t Load64(const uint8_t* data) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    return word;
+}
+
+#if defined(DIR2SRC_CRC32C_SSE42) && !defined(_MSC_VER)
+__attribute__((target("sse4.2")))
+#endif
+uint32_t Crc32cHardware(uint32_t crc, const uint8_t* data, size_t size) {
+    const Crc32cTables& tables = GetCrc32cTables();
+
+    for (auto [block_size, shift] : { std::pair{ long_block_size, tables.long_shift }, std::pair{ short_block_size, tables.short_shift } }) {
+        for (; size >= 3 * block_size; data += 3 * block_size, size -= 3 * block_size) {
+            uint32_t crc1 = 0;
+            uint32_t crc2 = 0;
+
+            for (size_t i = 0; i < block_size; i += 8) {
+                crc = DIR2SRC_CRC32C_WORD(crc, Load64(data + i));
+                crc1 = DIR2SRC_CRC32C_WORD(crc1, Load64(data + block_size + i));
+                crc2 = DIR2SRC_CRC32C_WORD(crc2, Load64(data + 2 * block_size + i));
+            }
+
+            crc = Shift(shift, crc) ^ crc1;
+            crc = Shift(shift, crc) ^ crc2;
+        }
+    }
+
+    for (; size >= 8; data += 8, size -= 8) {
+        crc = DIR2SRC_CRC32C_WORD(crc, Load64(data));
+    }
+
+    for (; size > 0; ++data, --size) {
+        crc = DIR2SRC_CRC32C_BYTE(crc, *data);
+    }
+
+    return crc;
+}
+
+#endif
+
+// Runs the register over more bytes, uninverted, so data can be fed in
+// pieces
+uint32_t ExtendCrc32c(uint32_t crc, const uint8_t* bytes, size_t size) {
+#if defined(DIR2SRC_CRC32C_SSE42) || defined(DIR2SRC_CRC32C_ARM)
+    static const bool has_instruction = HasCrc32cInstruction();
+
+    if (has_instruction) {
+        return Crc32cHardware(crc, bytes, size);
+    }
+#endif
+
+    return Crc32cPortable(crc, bytes, size);
+}
+
+} // namespace
+
+uint32_t Crc32c(const void* data, size_t size) {
+    return ~ExtendCrc32c(0xFFFFFFFF, (const uint8_t*)data, size);
+}
+)";
+
+// Declared in bin.h with checksums of compressed files, after
+// compressed_header
+constexpr std::string_view compressed_checksum_header = R"(
+// Whether a compressed resource still inflates to the bytes it was
+// generated from, a chunk at a time; <name>_crc32c is of those bytes.
+// Reads it through DecodeChunk(), so instrumented builds count it read.
+bool Verify(const CompressedResource& resource, uint32_t crc32c);
+)";
+
+// Follows checksum_source
+constexpr std::string_view compressed_checksum_source = R"(
+bool Verify(const CompressedResource& resource, uint32_t crc32c) {
+    std::vector<uint8_t> chunk(resource.chunk_size);
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t idx = 0; idx < resource.chunk_count; ++idx) {
+        if (!DecodeChunk(resource, idx, chunk.data())) return false;
+        crc = ExtendCrc32c(crc, chunk.data(), resource.ChunkSize(idx));
+    }
+
+    return ~crc == crc32c;
+}
+)";
+
+// FNV-1a over the root-relative path, so shard
+// membership doesn't depend on the platform or on other files in the tree
+size_t ShardIndex(std::string_view relative_path, size_t shard_count) {
+    uint32_t hash = 2166136261u;
+
+    for (char c : relative_path) {
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    }
+
+    return hash % shard_count;
+}
+
+// Each byte's literal padded to a fixed width, so lines are built from copies
+struct ByteLiterals {
+    char decimal[256][4];
+    char hex[256][4];
+};
+
+const ByteLiterals& GetByteLiterals() {
+    static const ByteLiterals byte_literals = [] {
+        ByteLiterals literals = {};
+        constexpr char hex_digits[] = "0123456789abcdef";
+
+        for (int c = 0; c < 256; ++c) {
+            // Pad with spaces, not zeros: a leading zero makes an octal literal
+            snprintf(literals.decimal[c], 4, "%3d", c);
+
+            literals.hex[c][0] = '0';
+            literals.hex[c][1] = 'x';
+            literals.hex[c][2] = hex_digits[c >> 4];
+            literals.hex[c][3] = hex_digits[c & 0xF];
+        }
+
+        return literals;
+    }();
+
+    return byte_literals;
+}
+
+constexpr size_t byte_literals_per_line = 12;
+
+// Of AppendByteLiterals() for a file of this size
+uint64_t ByteLiteralsSize(uint64_t file_size, bool hex_format) {
+    if (file_size == 0) return 0;
+
+    const uint64_t width = hex_format ? 4 : 3;
+    const uint64_t line_count = (file_size + byte_literals_per_line - 1) / byte_literals_per_line;
+
+    return line_count * 4 + file_size * width + (file_size - 1) * 2;
+}
+
+void AppendByteLiterals(std::string* out, std::span<const uint8_t> file_data, bool hex_format) {
+    if (file_data.empty()) return;
+
+    constexpr size_t split = byte_literals_per_line;
+
+    const auto& literals = hex_format ? GetByteLiterals().hex : GetByteLiterals().decimal;
+    const size_t width = hex_format ? 4 : 3;
+
+    const size_t offset = out->size();
+
+    out->resize(offset + ByteLiteralsSize(file_data.size(), hex_format));
+
+    char* p = out->data() + offset;
+
+    for (size_t i = 0; i < file_data.size(); ++i) {
+
+        if (i % split == 0) {
+            memcpy(p, "    ", 4);
+            p += 4;
+        }
+
+        memcpy(p, literals[file_data[i]], width);
+        p += width;
+
+        if (i != file_data.size() - 1) {
+            p[0] = ',';
+            p[1] = (i + 1) % split == 0 ? '\n' : ' ';
+            p += 2;
+        }
+    }
+}
+
+void AppendNumber(std::string* out, uint64_t number) {
+    char buffer[24];
+    auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out->append(buffer, end);
+}
+
+// Defines a type of <root>::dir2src unless the output already has, as
+// bin.h and each source with a file of that type do. The guard is named
+// for the root namespace and guard_name.
+void AppendSharedType(
+    std::string* out,
+    std::string_view root_namespace,
+    std::string_view guard_name,
+    std::string_view includes,
+    std::string_view type_source
+) {
+    std::string guard = "DIR2SRC_";
+    for (char c : root_namespace) {
+        guard.push_back(c == ':' ? '_' : (char)std::toupper((unsigned char)c));
+    }
+    guard.append("_").append(guard_name);
+
+    out->append("#ifndef ").append(guard).append("\n#define ").append(guard).append("\n\n");
+    out->append(includes).append("\n");
+    out->append("namespace ").append(root_namespace).append("::dir2src {\n");
+    out->append(type_source);
+    out->append("\n}\n\n#endif\n");
+}
+
+void AppendNulTerminatedArray(std::string* out, std::string_view root_namespace) {
+    AppendSharedType(out, root_namespace, "NUL_TERMINATED_ARRAY", "#include <cstddef>\n#include <string_view>\n", nul_terminated_array_source);
+}
+
+void AppendCompressedResource(std::string* out, std::string_view root_namespace) {
+    AppendSharedType(out, root_namespace, "COMPRESSED_RESOURCE", "#include <cstddef>\n", compressed_resource_source);
+}
+
+// The smallest page of any target, for page-aligned files
+constexpr uint64_t page_size = 4096;
+
+// Files outside the layout profile
+constexpr size_t no_layout_rank = SIZE_MAX;
+
+// Zero-padded, so section names sort in rank order
+void AppendLayoutRank(std::string* out, size_t layout_rank) {
+    char rank[24];
+    snprintf(rank, sizeof(rank), "%08zu", layout_rank);
+    out->append(rank);
+}
+
+// Places a profiled resource in a section of its own, named for its rank.
+// MSVC sorts the ".data$" sections it merges by suffix, so these come out
+// contiguous and in rank order with no help. ELF linkers need bin.order or
+// --sort-section=name.
+void AppendLayoutSection(std::string* out, size_t layout_rank) {
+    out->append("#if defined(_MSC_VER)\n#pragma section(\".data$dir2src");
+    AppendLayoutRank(out, layout_rank);
+    out->append("\", read, write)\n__declspec(allocate(\".data$dir2src");
+    AppendLayoutRank(out, layout_rank);
+    out->append("\"))\n#elif defined(__ELF__)\n__attribute__((section(\".data.dir2src.");
+    AppendLayoutRank(out, layout_rank);
+    out->append("\")))\n#endif\n");
+}
+
+void AppendResourceDefinition(
+    std::string* out,
+    std::string_view root_namespace,
+    std::span<const std::string_view> namespaces,
+    std::string_view array_name,
+    std::span<const uint8_t> file_data,
+    bool hex_format,
+    bool nul_terminated,
+    bool page_aligned,
+    size_t layout_rank,
+    std::string_view initializer_include = {}
+) {
+    if (nul_terminated) {
+        AppendNulTerminatedArray(out, root_namespace);
+        out->append("\n");
+    }
+
+    out->append("namespace ").append(root_namespace).append(" {\n");
+
+    for (auto n : namespaces) {
+        out->append("namespace ").append(n).append(" {\n");
+    }
+
+    out->append("\n");
+
+    if (page_aligned) {
+        out->append("alignas(");
+        AppendNumber(out, page_size);
+        out->append(layout_rank != no_layout_rank ? ")\n" : ") ");
+    }
+
+    if (layout_rank != no_layout_rank) {
+        AppendLayoutSection(out, layout_rank);
+    }
+
+    if (nul_terminated) {
+        out->append("::").append(root_namespace).append("::dir2src::NulTerminatedArray<");
+        AppendNumber(out, file_data.size());
+        out->append("> ").append(array_name).append(" = { {\n\n");
+    }
+    else {
+        out->append("std::array<uint8_t, ");
+        AppendNumber(out, file_data.size());
+        out->append("> ").append(array_name).append(" = {\n\n");
+    }
+
+    if (initializer_include.empty()) {
+        AppendByteLiterals(out, file_data, hex_format);
+        out->append("\n");
+    } else {
+        out->append("#include \"").append(initializer_include).append("\"\n");
+    }
+
+    out->append(nul_terminated ? "\n} };\n\n" : "\n};\n\n");
+
+    for (auto it = namespaces.rbegin(); it != namespaces.rend(); ++it) {
+        out->append("} // end of namespace ").append(*it).append("\n");
+    }
+    out->append("} // end of namespace ").append(root_namespace).append("\n");
+}
+
+// Gzips a compressible file into gzip_data, keeping it only if it's at most
+// max_percent of the file's size. Returns whether it was kept.
+bool GzipIfSmaller(std::string_view path, std::span<const uint8_t> file_data, uint32_t max_percent, std::vector<uint8_t>* gzip_data) {
+    gzip_data->clear();
+
+    if (file_data.empty() || !IsCompressible(ContentTypeOf(path, file_data))) {
+        return false;
+    }
+
+    Gzip(file_data, gzip_data);
+
+    if (gzip_data->size() * 100 > file_data.size() * max_percent) {
+        gzip_data->clear();
+        return false;
+    }
+
+    return true;
+}
+
+// The gzip of a resource, as <name>_gz next to it. Const, as nothing is
+// meant to write to it.
+void AppendGzipDefinition(
+    std::string* out,
+    std::string_view root_namespace,
+    std::span<const std::string_view> namespaces,
+    std::string_view array_name,
+    std::span<const uint8_t> gzip_data,
+    bool hex_format
+) {
+    out->append("\nnamespace ").append(root_namespace).append(" {\n");
+
+    for (auto n : namespaces) {
+        out->append("namespace ").append(n).append(" {\n");
+    }
+
+    out->append("\nextern const std::array<uint8_t, ");
+    AppendNumber(out, gzip_data.size());
+    out->append("> ").append(array_name).append("_gz = {\n\n");
+
+    AppendByteLiterals(out, gzip_data, hex_format);
+    out->append("\n\n};\n\n");
+
+    for (auto it = namespaces.rbegin(); it != namespaces.rend(); ++it) {
+        out->append("} // end of namespace ").append(*it).append("\n");
+    }
+    out->append("} // end of namespace ").append(root_namespace).append("\n");
+}
+
+// A compressed file as a CompressedResource over its chunks and their
+// offsets, which only it refers to. The chunks are still external, so
+// bin.order can name them: they are what a layout profile places.
+void AppendCompressedDefinition(
+    std::string* out,
+    std::string_view root_namespace,
+    std::span<const std::string_view> namespaces,
+    std::string_view array_name,
+    std::span<const uint8_t> chunk_data,
+    std::span<const uint64_t> chunk_offsets,
+    uint64_t chunk_size,
+    uint64_t uncompressed_size,
+    size_t cache_idx,
+    bool hex_format,
+    bool page_aligned,
+    size_t layout_rank
+) {
+    AppendCompressedResource(out, root_namespace);
+
+    out->append("\nnamespace ").append(root_namespace).append(" {\n");
+
+    for (auto n : namespaces) {
+        out->append("namespace ").append(n).append(" {\n");
+    }
+
+    out->append("\n");
+
+    if (page_aligned) {
+        out->append("alignas(");
+        AppendNumber(out, page_size);
+        out->append(layout_rank != no_layout_rank ? ")\n" : ") ");
+    }
+
+    if (layout_rank != no_layout_rank) {
+        AppendLayoutSection(out, layout_rank);
+    }
+
+    out->append("extern const std::array<uint8_t, ");
+    AppendNumber(out, chunk_data.size());
+    out->append("> ").append(array_name).append("_chunk_data = {\n\n");
+
+    AppendByteLiterals(out, chunk_data, hex_format);
+    out->append("\n\n};\n\nstatic const std::array<uint32_t, ");
+    AppendNumber(out, chunk_offsets.size());
+    out->append("> ").append(array_name).append("_chunk_offsets = {\n   ");
+
+    for (size_t i = 0; i < chunk_offsets.size(); ++i) {
+        out->append(i > 0 && i % 12 == 0 ? "\n    " : " ");
+        AppendNumber(out, chunk_offsets[i]);
+        out->append(",");
+    }
+
+    out->append("\n};\n\nextern const ::").append(root_namespace).append("::dir2src::CompressedResource ").append(array_name).append("{\n    ");
+    out->append(array_name).append("_chunk_data.data(),\n    ");
+    out->append(array_name).append("_chunk_offsets.data(),\n    ");
+    AppendNumber(out, chunk_offsets.size() - 1);
+    out->append(",\n    ");
+    AppendNumber(out, chunk_size);
+    out->append(",\n    ");
+    AppendNumber(out, uncompressed_size);
+    out->append(",\n    ");
+    AppendNumber(out, cache_idx);
+    out->append(",\n};\n\n");
+
+    for (auto it = namespaces.rbegin(); it != namespaces.rend(); ++it) {
+        out->append("} // end of namespace ").append(*it).append("\n");
+    }
+    out->append("} // end of namespace ").append(root_namespace).append("\n");
+}
+
+uint64_t ContentHash(std::span<const uint8_t> data) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (uint8_t c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+// As a quoted IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+void AppendHttpDate(std::string* out, int64_t unix_time) {
+    constexpr const char* weekdays[] = { "Thu", "Fri", "Sat", "Sun", "Mon", "Tue", "Wed" };
+    constexpr const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+    unix_time = std::max<int64_t>(unix_time, 0);
+
+    const int64_t days = unix_time / 86400;
+    const int64_t seconds = unix_time % 86400;
+
+    // Civil date of a day count, from Howard Hinnant's date algorithms
+    const int64_t shifted_days = days + 719468;
+    const int64_t era = shifted_days / 146097;
+    const int64_t day_of_era = shifted_days - era * 146097;
+    const int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const int64_t shifted_month = (5 * day_of_year + 2) / 153;
+    const int64_t day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+    const int64_t month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+    const int64_t year = year_of_era + era * 400 + (month <= 2);
+
+    char date[40];
+    snprintf(date, sizeof(date), "\"%s, %02d %s %04d %02d:%02d:%02d GMT\"",
+        weekdays[days % 7], (int)day, months[month - 1], (int)year,
+        (int)(seconds / 3600), (int)(seconds / 60 % 60), (int)(seconds % 60));
+
+    out->append(date);
+}
+
+// Itanium ABI name of the resource, which GNU-compatible compilers link
+// against. Namespace-scope variables aren't mangled with their type.
+void AppendMangledName(
+    std::string* out,
+    std::string_view root_namespace,
+    std::span<const std::string_view> namespaces,
+    std::string_view array_name
+) {
+    auto append_name = [&](std::string_view name) {
+        AppendNumber(out, name.size());
+        out->append(name);
+    };
+
+    out->append("_ZN");
+
+    // The root namespace may itself be nested, e.g. "Game::Assets"
+    for (size_t start = 0; start <= root_namespace.size();) {
+        size_t end = std::min(root_namespace.find("::", start), root_namespace.size());
+        append_name(root_namespace.substr(start, end - start));
+        start = end + 2;
+    }
+
+    for (auto n : namespaces) {
+        append_name(n);
+    }
+
+    append_name(array_name);
+    out->append("E");
+}
+
+// Escaped for a narrow string literal. Other bytes are written as octal
+// escapes, which unlike hex escapes never run into the next character.
+void AppendStringLiteral(std::string* out, std::string_view str) {
+    out->push_back('"');
+
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out->push_back('\\');
+            out->push_back(c);
+        }
+        else if ((unsigned char)c < 0x20 || (unsigned char)c >= 0x7F) {
+            char escaped[5];
+            snprintf(escaped, sizeof(escaped), "\\%03o", (unsigned char)c);
+            out->append(escaped);
+        }
+        else {
+            out->push_back(c);
+        }
+    }
+
+    out->push_back('"');
+}
+
+// Stub for a resource too big to be worth compiling. Where GNU inline
+// assembly is available the assembler copies the bytes in from a raw copy,
+// found next to the stub by adding raw_suffix to __FILE__. Builds whose
+// -ffile-prefix-map or -fmacro-prefix-map rewrites __FILE__ define
+// DIR2SRC_BULK_DIR as the output directory, a string literal, and the copy
+// is found at raw_path under it instead. Other compilers fall back to the
+// usual initializer, kept in initializer_include so the assembler route
+// never reads it, or stop with an #error when there's none.
+//
+// The stub carries a hash of the contents, as compilers don't report
+// .incbin files as dependencies and the object must still be rebuilt
+// when only the data changes. Its macros are undefined again, as a shard
+// holds any number of stubs.
+void AppendBulkResourceStub(
+    std::string* out,
+    std::string_view root_namespace,
+    std::span<const std::string_view> namespaces,
+    std::string_view array_name,
+    std::string_view raw_path,
+    std::string_view raw_suffix,
+    std::string_view initializer_include,
+    std::span<const uint8_t> file_data,
+    bool hex_format,
+    bool nul_terminated,
+    bool page_aligned,
+    size_t layout_rank
+) {
+    char content_hash[17];
+    snprintf(content_hash, sizeof(content_hash), "%016llx", (unsigned long long)ContentHash(file_data));
+
+    out->append("// Contents hash: ").append(content_hash).append(R"(
+
+#if defined(__GNUC__)
+
+#define DIR2SRC_STRINGIFY_(x) #x
+#define DIR2SRC_STRINGIFY(x) DIR2SRC_STRINGIFY_(x)
+#define DIR2SRC_SYMBOL DIR2SRC_STRINGIFY(__USER_LABEL_PREFIX__) ")");
+
+    AppendMangledName(out, root_namespace, namespaces, array_name);
+
+    out->append("\"\n\n#if defined(DIR2SRC_BULK_DIR)\n#define DIR2SRC_BULK_FILE DIR2SRC_BULK_DIR ");
+    AppendStringLiteral(out, std::string("/").append(raw_path));
+    out->append("\n#else\n#define DIR2SRC_BULK_FILE __FILE__ ");
+    AppendStringLiteral(out, raw_suffix);
+
+    // Typed and sized like a compiled array, for copy relocations and
+    // sanitizers
+    out->append(R"(
+#endif
+
+#if defined(__ELF__)
+#define DIR2SRC_SYMBOL_TYPE ".type " DIR2SRC_SYMBOL ", %object\n"
+#define DIR2SRC_SYMBOL_SIZE ".size " DIR2SRC_SYMBOL ", . - " DIR2SRC_SYMBOL "\n"
+#else
+#define DIR2SRC_SYMBOL_TYPE
+#define DIR2SRC_SYMBOL_SIZE
+#endif
+)");
+
+    if (layout_rank != no_layout_rank) {
+        out->append("\n#if defined(__ELF__)\n#define DIR2SRC_DATA_SECTION \".section .data.dir2src.");
+        AppendLayoutRank(out, layout_rank);
+        out->append(R"(,\"aw\"\n"
+#else
+#define DIR2SRC_DATA_SECTION ".data\n"
+#endif
+)");
+    }
+
+    out->append(layout_rank != no_layout_rank ? "\n__asm__(\n    DIR2SRC_DATA_SECTION\n" : "\n__asm__(\n    \".data\\n\"\n");
+
+    out->append("    \".balign ");
+    AppendNumber(out, page_aligned ? page_size : 16);
+    out->append("\\n\"\n");
+
+    out->append(R"(    ".globl " DIR2SRC_SYMBOL "\n"
+    DIR2SRC_SYMBOL_TYPE
+    DIR2SRC_SYMBOL ":\n"
+    ".incbin \"" DIR2SRC_BULK_FILE "\"\n")");
+
+    if (nul_terminated) {
+        out->append(R"(
+    ".byte 0\n")");
+    }
+
+    out->append("\n    DIR2SRC_SYMBOL_SIZE");
+
+    // Nothing else shares the last page, so it can be released too
+    if (page_aligned) {
+        out->append("\n    \".balign ");
+        AppendNumber(out, page_size);
+        out->append("\\n\"");
+    }
+
+    out->append(R"(
+    ".text\n"
+);
+)");
+
+    if (layout_rank != no_layout_rank) {
+        out->append("\n#undef DIR2SRC_DATA_SECTION");
+    }
+
+    out->append(R"(
+#undef DIR2SRC_SYMBOL_SIZE
+#undef DIR2SRC_SYMBOL_TYPE
+#undef DIR2SRC_BULK_FILE
+#undef DIR2SRC_SYMBOL
+#undef DIR2SRC_STRINGIFY
+#undef DIR2SRC_STRINGIFY_
+
+#else
+
+)");
+
+    if (initializer_include.empty()) {
+        out->append("#error ");
+        AppendStringLiteral(out, std::string(raw_path).append(" is embedded by the assembler, which needs GNU inline assembly; regenerate with --bulk-fallback"));
+        out->append("\n");
+    }
+    else {
+        AppendResourceDefinition(out, root_namespace, namespaces, array_name, file_data, hex_format, nul_terminated, page_aligned, layout_rank, initializer_include);
+    }
+
+    out->append("\n#endif\n");
+}
+
+// bin.pack layout, read back by pack_source. Little-endian like every
+// target the runtime maps it on.
+struct PackFileHeader {
+    char magic[8] = "dir2src";
+    uint32_t version = 1;
+    uint32_t alignment = 0;
+    uint64_t file_count = 0;
+    uint64_t index_offset = 0;
+    uint64_t path_pool_offset = 0;
+    uint64_t path_pool_size = 0;
+    uint64_t pack_size = 0;
+};
+
+struct PackFileEntry {
+    uint64_t data_offset;
+    uint64_t size;
+    uint32_t path_offset;
+    uint32_t path_size;
+};
+
+static_assert(sizeof(PackFileHeader) == 56 && sizeof(PackFileEntry) == 24);
+
+// Files of at least a page start on one, so each can be mapped, prefetched
+// or released on its own; smaller files are packed more tightly
+constexpr uint64_t pack_small_file_alignment = 16;
+
+// What GCC 12 holds at -O2 for a translation unit of initializers: about
+// this much for any, plus this much per embedded byte. MSVC needs more.
+constexpr uint64_t compile_memory_base = 32 << 20;
+constexpr uint64_t compile_memory_per_byte = 150;
+
+uint64_t AlignUp(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Pooled buffers bigger than this are freed rather than kept for reuse
+constexpr size_t max_pooled_buffer_size = 16 << 20;
+
+} // namespace
+
+std::vector<std::string> SplitString(std::string string, const std::string& delimiter) {
+    std::vector<std::string> ret;
+
+    size_t delimiter_idx = 0;
+    while (delimiter_idx != std::string::npos) {
+        delimiter_idx = string.find(delimiter);
+        std::string token = string.substr(0, delimiter_idx);
+
+        if (!token.empty()) {
+            ret.push_back(token);
+        }
+        string.erase(0, delimiter_idx + 1);
+    }
+
+    return ret;
+}
+
+bool Generate(FileSource& source, OutputSink& sink, const Options& options, GenerateResult* result) {
+    GenerateResult local_result;
+    if (result == nullptr) {
+        result = &local_result;
+    }
+
+    // Paths and names live as long as the result, everything per file is
+    // carved out of its arena or reuses pooled buffers
+    Arena& arena = result->arena;
+
+    bool success = true;
+
+    const bool sharded = options.shard_count > 0;
+    const bool hex_format = options.format == Format::HEX;
+
+    // Shard 0 owns the header so parallel shards never write the same file
+    const bool write_header = !sharded || options.shard_index == 0;
+
+    // Packs have no embedded sources to stand in for or to skip
+    const bool dev_accessors = options.dev_accessors && !options.pack;
+    const bool header_only = options.header_only && !options.pack;
+
+    // A pack's checksums would have to be rebuilt into bin.h with it
+    const bool checksums = options.checksums && !options.pack;
+    const bool http_metadata = options.http_metadata && !options.pack;
+    const bool gzip = options.gzip_max_percent > 0 && !options.pack;
+
+    // Packs are mapped to be read in place
+    const bool compression = !options.compressed_patterns.empty() && !options.pack;
+
+    // A pack's file count is only known once it's mapped
+    const bool instrument = options.instrument && !options.pack;
+
+    const std::string_view source_preamble = dev_accessors ? cpp_file_dev_preamble : cpp_file_preamble;
+    const std::string_view source_epilogue = dev_accessors ? cpp_file_dev_epilogue : std::string_view();
+
+    if (sharded && options.pack) {
+        fprintf(stderr, "A pack can't be sharded\n");
+        return false;
+    }
+
+    if (instrument && !options.generate_index) {
+        fprintf(stderr, "Instrumenting needs the index\n");
+        return false;
+    }
+
+    PathFilter filter;
+
+    for (const auto& pattern : options.include_patterns) filter.AddInclude(pattern);
+    for (const auto& pattern : options.exclude_patterns) filter.AddExclude(pattern);
+
+    PathFilter nul_terminated_filter;
+
+    for (const auto& pattern : options.nul_terminated_patterns) nul_terminated_filter.AddInclude(pattern);
+
+    PathFilter compressed_filter;
+
+    if (compression) {
+        if (options.compression_chunk_size == 0 || options.compression_chunk_size > UINT32_MAX) {
+            fprintf(stderr, "Invalid compression chunk size %llu\n", (unsigned long long)options.compression_chunk_size);
+            return false;
+        }
+
+        for (const auto& pattern : options.compressed_patterns) compressed_filter.AddInclude(pattern);
+    }
+
+    // A file's position in the layout profile, its first if listed twice
+    std::unordered_map<std::string_view, size_t> layout_ranks;
+
+    for (const auto& path : options.layout_profile) {
+        layout_ranks.emplace(path, layout_ranks.size());
+    }
+
+    auto layout_rank_of = [&](std::string_view path) {
+        auto it = layout_ranks.find(path);
+        return it != layout_ranks.end() ? it->second : no_layout_rank;
+    };
+
+    // The ignore file is only read when listed, so sources without one
+    // don't report a failed read
+    bool has_ignore_file = false;
+
+    if (!options.ignore_file_name.empty()) {
+        success &= source.ListDirectory("", [&](const DirectoryEntry& entry) {
+            has_ignore_file |= !entry.is_directory && entry.name == options.ignore_file_name;
+        });
+    }
+
+    if (has_ignore_file) {
+        std::vector<uint8_t> ignore_file;
+        success &= source.ReadFile(options.ignore_file_name, &ignore_file);
+
+        // Editing it changes what's embedded
+        result->input_paths.push_back(arena.CopyString(options.ignore_file_name));
+
+        std::string_view lines((const char*)ignore_file.data(), ignore_file.size());
+
+        while (!lines.empty()) {
+            size_t line_end = std::min(lines.find('\n'), lines.size());
+            std::string_view line = lines.substr(0, line_end);
+            lines.remove_prefix(std::min(line_end + 1, lines.size()));
+
+            if (!line.empty() && line.front() != '#') {
+                filter.AddExclude(line);
+            }
+        }
+    }
+
+    struct OpenDirectory {
+        std::string_view path;
+        std::span<std::string_view> namespaces;
+
+        // Matched an include pattern, so everything below it is included
+        bool included = false;
+
+        // Likewise for the NUL-terminated and compressed patterns
+        bool nul_terminated = false;
+        bool compressed = false;
+    };
+
+    enum class FileRoute {
+        SOURCE,  // own translation unit, or the shard's
+        BATCHED, // combined with the small files around it
+        BULK,    // raw copy pulled in by the assembler where possible
+    };
+
+    struct FileJob {
+        std::string_view relative_path;
+        std::string_view array_name;
+        std::span<std::string_view> namespaces;
+        uint64_t size = 0;
+        FileRoute route = FileRoute::SOURCE;
+        size_t batch_idx = 0;
+        bool nul_terminated = false;
+        bool compressed = false;
+        size_t layout_rank = no_layout_rank;
+        uint32_t checksum = 0;
+
+        // With HTTP metadata
+        int64_t modified_time = 0;
+        uint64_t content_hash = 0;
+        std::string_view content_type;
+
+        // With gzip, the size of the kept gzip; zero for none. Its hash
+        // with HTTP metadata too.
+        uint64_t gzip_size = 0;
+        uint64_t gzip_hash = 0;
+
+        // Of compressed files, their slot in the decoded cache
+        size_t cache_idx = 0;
+
+        // The symbol the bytes are defined as: array_name, or with
+        // instrumentation <array_name>_bytes, which the ProfiledResource
+        // declared as array_name reads
+        std::string_view defined_name;
+    };
+
+    // Small files are batched per directory, so adding one only disturbs
+    // the batches of its own directory
+    struct Batch {
+        std::string_view path;
+        uint64_t size = 0;
+        size_t last_pipeline_idx = 0;
+        std::string text;
+    };
+
+    // Walk the tree first, the header needs every file and its size
+
+    std::vector<FileJob> jobs;
+    std::vector<size_t> in_shard_job_indices;
+    size_t compressed_file_count = 0;
+    std::vector<Batch> batches;
+
+    // Files the header describes but this run doesn't otherwise read: those
+    // of other shards, or all of them for just the header. Only read when
+    // the listing can't give what the header needs of them.
+    std::vector<size_t> header_read_job_indices;
+
+    // Shards are combined already, so only bulk files leave them
+    const bool route_small = !sharded && !options.pack && options.small_file_size > 0;
+    const bool route_bulk = !options.pack && options.bulk_file_size > 0;
+
+    // Where a bulk file's raw copy goes, from the output root and from its
+    // stub, and the stub's spelling of its fallback initializer,
+    // <path>.inc. A shard holds many stubs, so it names their raw copies
+    // after their symbols.
+    struct BulkPaths {
+        std::string raw_path;
+        std::string raw_suffix;
+        std::string initializer_include;
+    };
+
+    auto bulk_paths_of = [&](const FileJob& job) {
+        BulkPaths paths;
+
+        if (sharded) {
+            paths.raw_suffix = ".";
+            AppendMangledName(&paths.raw_suffix, options.root_namespace, job.namespaces, job.defined_name);
+            paths.raw_suffix.append(".bin");
+            paths.raw_path = "bin_" + std::to_string(ShardIndex(job.relative_path, options.shard_count)) + ".cpp" + paths.raw_suffix;
+        }
+        else {
+            paths.raw_suffix = ".bin";
+            paths.raw_path = std::string(job.relative_path).append(".cpp.bin");
+        }
+
+        if (options.bulk_fallback) {
+            paths.initializer_include = sharded ? job.relative_path : job.relative_path.substr(job.relative_path.rfind('/') + 1);
+            paths.initializer_include.append(".inc");
+        }
+
+        return paths;
+    };
+
+    std::vector<OpenDirectory> open_directory_list{ OpenDirectory{ .included = !filter.HasIncludes() } };
+
+    // Entries are filtered before their path is copied into the arena
+    std::string entry_path;
+
+    // Each listing is sorted by name, byte-wise like the index, so neither
+    // the filesystem's order nor the stack's decides the output's. Names are
+    // only valid during the visit, so they're copied out first.
+    struct ListedEntry {
+        size_t name_offset = 0;
+        size_t name_size = 0;
+        bool is_directory = false;
+        uint64_t size = 0;
+        int64_t modified_time = 0;
+    };
+
+    std::string listed_names;
+    std::vector<ListedEntry> listed_entries;
+
+    // Module partitions, one per directory in the root whether filtered or
+    // not, so build systems can name them from a listing of the root
+    std::vector<std::string_view> top_level_directory_names;
+
+    while (!open_directory_list.empty()) {
+        OpenDirectory dir = open_directory_list.back();
+        open_directory_list.pop_back();
+
+        // Directory timestamps change when entries are added or removed
+        result->input_paths.push_back(dir.path);
+
+        const size_t directory_first_batch_idx = batches.size();
+
+        listed_names.clear();
+        listed_entries.clear();
+
+        success &= source.ListDirectory(dir.path, [&](const DirectoryEntry& entry) {
+            listed_entries.push_back({ listed_names.size(), entry.name.size(), entry.is_directory, entry.size, entry.modified_time });
+            listed_names.append(entry.name);
+        });
+
+        auto name_of = [&](const ListedEntry& listed_entry) {
+            return std::string_view(listed_names).substr(listed_entry.name_offset, listed_entry.name_size);
+        };
+
+        std::sort(listed_entries.begin(), listed_entries.end(), [&](const ListedEntry& a, const ListedEntry& b) {
+            return name_of(a) < name_of(b);
+        });
+
+        // Subdirectories are pushed in order, then reversed to pop in order
+        const size_t first_subdirectory_idx = open_directory_list.size();
+
+        for (const ListedEntry& listed_entry : listed_entries) {
+            const DirectoryEntry entry{ name_of(listed_entry), listed_entry.is_directory, listed_entry.size, listed_entry.modified_time };
+
+            if (dir.path.empty() && entry.is_directory && !options.module_name.empty()) {
+                top_level_directory_names.push_back(CodeFriendlyString(arena, entry.name));
+            }
+
+            entry_path.assign(dir.path);
+            if (!dir.path.empty()) entry_path.push_back('/');
+            entry_path.append(entry.name);
+
+            if (filter.IsExcluded(entry_path, entry.is_directory) || (has_ignore_file && entry_path == options.ignore_file_name)) {
+                continue;
+            }
+
+            const bool included = dir.included || filter.IsIncluded(entry_path, entry.is_directory);
+
+            if (!included && !entry.is_directory) {
+                continue;
+            }
+
+            if (options.prune_unprofiled && !entry.is_directory && layout_rank_of(entry_path) == no_layout_rank) {
+                continue;
+            }
+
+            const bool nul_terminated = dir.nul_terminated ||
+                (nul_terminated_filter.HasIncludes() && nul_terminated_filter.IsIncluded(entry_path, entry.is_directory));
+
+            const bool compressed = dir.compressed ||
+                (compression && compressed_filter.IsIncluded(entry_path, entry.is_directory));
+
+            std::string_view relative_path = arena.CopyString(entry_path);
+
+            if (entry.is_directory) {
+                auto namespaces = arena.AllocateArray<std::string_view>(dir.namespaces.size() + 1);
+                std::copy(dir.namespaces.begin(), dir.namespaces.end(), namespaces.begin());
+                namespaces.back() = CodeFriendlyString(arena, entry.name);
+
+                open_directory_list.push_back({ relative_path, namespaces, included, nul_terminated, compressed });
+                continue;
+            }
+
+            bool in_shard = !sharded || ShardIndex(relative_path, options.shard_count) == options.shard_index;
+
+            if (in_shard || write_header) {
+                result->input_paths.push_back(relative_path);
+            }
+
+            FileRoute route = FileRoute::SOURCE;
+            size_t batch_idx = 0;
+
+            // Compressed files are small enough already
+            if (route_bulk && entry.size >= options.bulk_file_size && !compressed) {
+                route = FileRoute::BULK;
+            }
+            else if (route_small && entry.size <= options.small_file_size) {
+                route = FileRoute::BATCHED;
+
+                if (batches.size() == directory_first_batch_idx ||
+                    (batches.back().size > 0 && batches.back().size + entry.size > options.small_batch_size)) {
+                    std::string batch_number = std::to_string(batches.size() - directory_first_batch_idx);
+
+                    batches.push_back({ dir.path.empty()
+                        ? arena.Concat({ "bin_small_", batch_number, ".cpp" })
+                        : arena.Concat({ dir.path, "/bin_small_", batch_number, ".cpp" }) });
+                }
+
+                batch_idx = batches.size() - 1;
+                batches.back().size += entry.size;
+                batches.back().last_pipeline_idx = in_shard_job_indices.size();
+            }
+
+            if (in_shard && !header_only) {
+                in_shard_job_indices.push_back(jobs.size());
+            }
+            else if (write_header && (checksums || http_metadata || gzip ||
+                                      (sharded && options.minify && MinifyLanguageOf(relative_path) != MinifyLanguage::NONE))) {
+                header_read_job_indices.push_back(jobs.size());
+            }
+
+            jobs.push_back({
+                relative_path,
+                CodeFriendlyString(arena, entry.name),
+                dir.namespaces,
+                entry.size,
+                route,
+                batch_idx,
+                nul_terminated && !compressed,
+                compressed,
+                layout_rank_of(relative_path),
+                0,
+                entry.modified_time,
+            });
+
+            if (compressed) {
+                jobs.back().cache_idx = compressed_file_count++;
+            }
+
+            // Compressed files' readers count their own accesses
+            jobs.back().defined_name = instrument && !compressed
+                ? arena.Concat({ jobs.back().array_name, "_bytes" })
+                : jobs.back().array_name;
+        }
+
+        std::reverse(open_directory_list.begin() + first_subdirectory_idx, open_directory_list.end());
+    }
+
+    // Packs are written in pipeline order, so the profiled files go first
+    if (options.pack && !layout_ranks.empty()) {
+        std::stable_sort(in_shard_job_indices.begin(), in_shard_job_indices.end(), [&](size_t a, size_t b) {
+            return jobs[a].layout_rank < jobs[b].layout_rank;
+        });
+    }
+
+    // Sized from the listing with the same writers given empty files, so the
+    // plan reads nothing and follows the output as it changes
+    if (options.plan) {
+        std::string scratch;
+
+        auto page_aligned_of = [&](const FileJob& job) {
+            return options.page_align_file_size > 0 && job.size >= options.page_align_file_size;
+        };
+
+        // An empty file's definition spells its size "0"
+        auto definition_size = [&](const FileJob& job, bool hex) {
+            scratch.clear();
+            AppendResourceDefinition(&scratch, options.root_namespace, job.namespaces, job.defined_name, {}, hex,
+                                     job.nul_terminated, page_aligned_of(job), job.layout_rank);
+
+            return scratch.size() - 1 + std::to_string(job.size).size() + ByteLiteralsSize(job.size, hex);
+        };
+
+        // The stub, raw copy and any fallback initializer together
+        auto bulk_size = [&](const FileJob& job, bool hex) {
+            const BulkPaths paths = bulk_paths_of(job);
+
+            scratch.clear();
+            AppendBulkResourceStub(&scratch, options.root_namespace, job.namespaces, job.defined_name, paths.raw_path, paths.raw_suffix,
+                                   paths.initializer_include, {}, hex, job.nul_terminated, page_aligned_of(job), job.layout_rank);
+
+            if (paths.initializer_include.empty()) {
+                return scratch.size() + job.size;
+            }
+
+            return scratch.size() - 1 + std::to_string(job.size).size() + job.size + ByteLiteralsSize(job.size, hex) + 1;
+        };
+
+        auto add_file = [&](PlanEntry& entry, const FileJob& job, uint64_t array_bytes, uint64_t hex_bytes) {
+            entry.file_count += 1;
+            entry.input_bytes += job.size;
+            entry.array_bytes += array_bytes;
+            entry.hex_bytes += hex_bytes;
+        };
+
+        // Sources open with the preamble and end with the epilogue
+        auto add_source = [&](std::string_view path) {
+            const uint64_t bytes = source_preamble.size() + source_epilogue.size();
+            result->planned_outputs.push_back({ path, 0, 0, bytes, bytes, compile_memory_base });
+            return result->planned_outputs.size() - 1;
+        };
+
+        std::vector<size_t> shard_outputs;
+        std::vector<size_t> batch_outputs(batches.size(), SIZE_MAX);
+
+        if (sharded && !header_only) {
+            for (size_t i = 0; i < options.shard_count; ++i) {
+                shard_outputs.push_back(add_source(arena.Concat({ "bin_", std::to_string(i), ".cpp" })));
+            }
+        }
+
+        for (const FileJob& job : jobs) {
+            const size_t slash_idx = job.relative_path.rfind('/');
+            const std::string_view directory = job.relative_path.substr(0, slash_idx == std::string_view::npos ? 0 : slash_idx);
+            const uint64_t array_bytes = definition_size(job, false);
+            const uint64_t hex_bytes = definition_size(job, true);
+
+            // A directory's files are listed together
+            if (result->planned_directories.empty() || result->planned_directories.back().path != directory) {
+                result->planned_directories.push_back({ directory });
+            }
+
+            add_file(result->planned_directories.back(), job, array_bytes, hex_bytes);
+
+            if (options.pack || header_only) {
+                continue;
+            }
+
+            size_t output_idx = 0;
+
+            if (sharded) {
+                output_idx = shard_outputs[ShardIndex(job.relative_path, options.shard_count)];
+
+                // Definitions are separated by a blank line
+                if (job.route == FileRoute::BULK) {
+                    add_file(result->planned_outputs[output_idx], job, bulk_size(job, false) + 1, bulk_size(job, true) + 1);
+                }
+                else {
+                    add_file(result->planned_outputs[output_idx], job, array_bytes + 1, hex_bytes + 1);
+                }
+            }
+            else if (job.route == FileRoute::BATCHED) {
+                if (batch_outputs[job.batch_idx] == SIZE_MAX) {
+                    batch_outputs[job.batch_idx] = add_source(batches[job.batch_idx].path);
+                }
+
+                output_idx = batch_outputs[job.batch_idx];
+                add_file(result->planned_outputs[output_idx], job, array_bytes + 1, hex_bytes + 1);
+            }
+            else if (job.route == FileRoute::BULK) {
+                output_idx = add_source(arena.Concat({ job.relative_path, ".cpp" }));
+                add_file(result->planned_outputs[output_idx], job, bulk_size(job, false), bulk_size(job, true));
+            }
+            else {
+                output_idx = add_source(arena.Concat({ job.relative_path, ".cpp" }));
+                add_file(result->planned_outputs[output_idx], job, array_bytes, hex_bytes);
+            }
+
+            // Where the assembler embeds bulk files they cost next to nothing,
+            // elsewhere their initializer is compiled like any other
+            result->planned_outputs[output_idx].compile_memory += job.size * compile_memory_per_byte;
+        }
+
+        // Laid out as the pack is written below
+        if (options.pack) {
+            uint64_t pack_size = AlignUp(sizeof(PackFileHeader), alignof(PackFileEntry)) + jobs.size() * sizeof(PackFileEntry);
+            uint64_t input_bytes = 0;
+
+            for (const auto& job : jobs) {
+                pack_size += job.relative_path.size();
+                input_bytes += job.size;
+            }
+
+            pack_size = AlignUp(pack_size, page_size);
+
+            for (size_t job_idx : in_shard_job_indices) {
+                const FileJob& job = jobs[job_idx];
+                const bool page_aligned = page_aligned_of(job);
+
+                pack_size = AlignUp(pack_size, job.size >= page_size || page_aligned ? page_size : pack_small_file_alignment);
+                pack_size += job.size + job.nul_terminated;
+
+                if (page_aligned) {
+                    pack_size = AlignUp(pack_size, page_size);
+                }
+            }
+
+            result->planned_outputs.push_back({ "bin.pack", jobs.size(), input_bytes, pack_size, pack_size, 0 });
+        }
+
+        return success;
+    }
+
+    // Sized and checksummed as their own shard will, minified or not, but
+    // counted there
+    if (!header_read_job_indices.empty()) {
+        std::atomic<size_t> next_header_read_idx = 0;
+        std::atomic<bool> header_read_success = true;
+
+        std::vector<std::thread> header_read_threads;
+
+        for (size_t i = 0; i < std::max<size_t>(options.read_threads, 1); ++i) {
+            header_read_threads.emplace_back([&] {
+                std::vector<uint8_t> file_data;
+                std::vector<uint8_t> gzip_data;
+
+                for (size_t idx = next_header_read_idx++; idx < header_read_job_indices.size(); idx = next_header_read_idx++) {
+                    FileJob& job = jobs[header_read_job_indices[idx]];
+
+                    if (!source.ReadFile(job.relative_path, &file_data)) {
+                        header_read_success = false;
+                        continue;
+                    }
+
+                    if (options.minify) {
+                        Minify(MinifyLanguageOf(job.relative_path), &file_data);
+                    }
+
+                    job.size = file_data.size();
+                    job.checksum = checksums ? Crc32c(file_data) : 0;
+
+                    if (http_metadata) {
+                        job.content_hash = ContentHash(file_data);
+                        job.content_type = ContentTypeOf(job.relative_path, file_data);
+                    }
+
+                    if (gzip && GzipIfSmaller(job.relative_path, file_data, options.gzip_max_percent, &gzip_data)) {
+                        job.gzip_size = gzip_data.size();
+                        job.gzip_hash = http_metadata ? ContentHash(gzip_data) : 0;
+                    }
+                }
+            });
+        }
+
+        for (auto& thread : header_read_threads) {
+            thread.join();
+        }
+
+        success &= header_read_success;
+    }
+
+    // Then read, encode and write the files of this shard, each stage running
+    // concurrently with the others and connected by bounded queues. Buffers
+    // cycle back to the stage that fills them instead of being freed.
+
+    struct ReadFileJob {
+        size_t pipeline_idx = 0;
+        bool success = false;
+        std::vector<uint8_t> file_data;
+    };
+
+    struct EncodedFileJob {
+        size_t pipeline_idx = 0;
+        bool success = false;
+        std::string text;
+
+        // Bulk files only: the raw copy and any fallback initializer
+        std::string raw_path;
+        std::string data;
+        std::string initializer;
+
+        // Packs take files as they were read
+        std::vector<uint8_t> file_data;
+    };
+
+    const size_t read_threads = std::max<size_t>(options.read_threads, 1);
+    const size_t encode_threads = options.encode_threads > 0
+        ? options.encode_threads
+        : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    const size_t queue_capacity = 2 * encode_threads;
+
+    BoundedQueue<ReadFileJob> read_queue(queue_capacity);
+    BoundedQueue<EncodedFileJob> encoded_queue(queue_capacity);
+
+    // Enough for every buffer that can be in flight at once
+    BoundedQueue<std::vector<uint8_t>> file_buffer_pool(queue_capacity + read_threads + encode_threads);
+    BoundedQueue<std::string> text_buffer_pool(2 * queue_capacity + encode_threads);
+
+    // Each stage knows how many items it will take, so no end markers are needed
+    std::atomic<size_t> next_read_idx = 0;
+    std::atomic<size_t> next_encode_idx = 0;
+
+    std::atomic<size_t> minified_file_count = 0;
+    std::atomic<uint64_t> minified_bytes_saved = 0;
+
+    std::atomic<size_t> gzipped_file_count = 0;
+    std::atomic<uint64_t> gzipped_bytes_saved = 0;
+
+    // Definitions are retired in walk order, so a reader that stalls would
+    // otherwise leave every later definition parked until it catches up.
+    // Readers stay within a window of the next definition to retire.
+    std::atomic<size_t> next_definition_idx = 0;
+    const size_t reorder_window = 2 * queue_capacity + read_threads + encode_threads;
+
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < read_threads; ++i) {
+        threads.emplace_back([&] {
+            for (size_t idx = next_read_idx++; idx < in_shard_job_indices.size(); idx = next_read_idx++) {
+                for (size_t retired = next_definition_idx.load(); idx >= retired + reorder_window; retired = next_definition_idx.load()) {
+                    next_definition_idx.wait(retired);
+                }
+
+                ReadFileJob read_job;
+                read_job.pipeline_idx = idx;
+
+                file_buffer_pool.TryPop(&read_job.file_data);
+
+                read_job.success = source.ReadFile(
+                    jobs[in_shard_job_indices[idx]].relative_path,
+                    &read_job.file_data);
+
+                read_queue.Push(std::move(read_job));
+            }
+        });
+    }
+
+    for (size_t i = 0; i < encode_threads; ++i) {
+        threads.emplace_back([&] {
+            std::vector<uint8_t> gzip_data;
+            std::vector<uint8_t> chunk_data;
+            std::vector<uint64_t> chunk_offsets;
+
+            for (size_t idx = next_encode_idx++; idx < in_shard_job_indices.size(); idx = next_encode_idx++) {
+                ReadFileJob read_job = read_queue.Pop();
+                FileJob& job = jobs[in_shard_job_indices[read_job.pipeline_idx]];
+
+                if (options.minify && read_job.success) {
+                    const MinifyLanguage language = MinifyLanguageOf(job.relative_path);
+
+                    if (language != MinifyLanguage::NONE) {
+                        const size_t original_size = read_job.file_data.size();
+                        Minify(language, &read_job.file_data);
+
+                        minified_file_count.fetch_add(1, std::memory_order_relaxed);
+                        minified_bytes_saved.fetch_add(original_size - read_job.file_data.size(), std::memory_order_relaxed);
+                    }
+                }
+
+                // Only this thread touches the job now; the header is sized from
+                // what was actually read
+                job.size = read_job.file_data.size();
+
+                if (checksums) {
+                    job.checksum = Crc32c(read_job.file_data);
+                }
+
+                if (http_metadata) {
+                    job.content_hash = ContentHash(read_job.file_data);
+                    job.content_type = ContentTypeOf(job.relative_path, read_job.file_data);
+                }
+
+                const bool page_aligned = options.page_align_file_size > 0 && job.size >= options.page_align_file_size;
+
+                EncodedFileJob encoded_job;
+                encoded_job.pipeline_idx = read_job.pipeline_idx;
+                encoded_job.success = read_job.success;
+
+                if (options.pack) {
+                    encoded_job.file_data = std::move(read_job.file_data);
+                    encoded_queue.Push(std::move(encoded_job));
+                    continue;
+                }
+
+                if (!text_buffer_pool.TryPop(&encoded_job.text)) {
+                    encoded_job.text = sink.AcquireBuffer();
+                }
+
+                if (!sharded && job.route != FileRoute::BATCHED) {
+                    encoded_job.text.append(source_preamble);
+                }
+
+                if (job.route == FileRoute::BULK) {
+                    const BulkPaths paths = bulk_paths_of(job);
+
+                    AppendBulkResourceStub(
+                        &encoded_job.text,
+                        options.root_namespace,
+                        job.namespaces,
+                        job.defined_name,
+                        paths.raw_path,
+                        paths.raw_suffix,
+                        paths.initializer_include,
+                        read_job.file_data,
+                        hex_format,
+                        job.nul_terminated,
+                        page_aligned,
+                        job.layout_rank);
+
+                    encoded_job.raw_path = paths.raw_path;
+                    encoded_job.data.assign((const char*)read_job.file_data.data(), read_job.file_data.size());
+
+                    if (options.bulk_fallback) {
+                        AppendByteLiterals(&encoded_job.initializer, read_job.file_data, hex_format);
+                        encoded_job.initializer.append("\n");
+                    }
+                }
+                else if (job.compressed) {
+                    chunk_data.clear();
+                    chunk_offsets.clear();
+                    DeflateChunks(read_job.file_data, options.compression_chunk_size, &chunk_data, &chunk_offsets);
+
+                    // Offsets are 32-bit, an array that big wouldn't compile anyway
+                    if (chunk_data.size() > UINT32_MAX) {
+                        fprintf(stderr, "%.*s is too big to compress\n", (int)job.relative_path.size(), job.relative_path.data());
+                        encoded_job.success = false;
+                    }
+
+                    AppendCompressedDefinition(
+                        &encoded_job.text,
+                        options.root_namespace,
+                        job.namespaces,
+                        job.array_name,
+                        chunk_data,
+                        chunk_offsets,
+                        options.compression_chunk_size,
+                        read_job.file_data.size(),
+                        job.cache_idx,
+                        hex_format,
+                        page_aligned,
+                        job.layout_rank);
+                }
+                else {
+                    AppendResourceDefinition(
+                        &encoded_job.text,
+                        options.root_namespace,
+                        job.namespaces,
+                        job.defined_name,
+                        read_job.file_data,
+                        hex_format,
+                        job.nul_terminated,
+                        page_aligned,
+                        job.layout_rank);
+                }
+
+                // Compressed in this stage, which has the most threads
+                if (gzip && GzipIfSmaller(job.relative_path, read_job.file_data, options.gzip_max_percent, &gzip_data)) {
+                    job.gzip_size = gzip_data.size();
+                    job.gzip_hash = http_metadata ? ContentHash(gzip_data) : 0;
+
+                    AppendGzipDefinition(&encoded_job.text, options.root_namespace, job.namespaces, job.array_name, gzip_data, hex_format);
+
+                    gzipped_file_count.fetch_add(1, std::memory_order_relaxed);
+                    gzipped_bytes_saved.fetch_add(read_job.file_data.size() - gzip_data.size(), std::memory_order_relaxed);
+                }
+
+                if (!sharded && job.route != FileRoute::BATCHED) {
+                    encoded_job.text.append(source_epilogue);
+                }
+
+                if (read_job.file_data.capacity() <= max_pooled_buffer_size) {
+                    read_job.file_data.clear();
+                    file_buffer_pool.TryPush(read_job.file_data);
+                }
+
+                encoded_queue.Push(std::move(encoded_job));
+            }
+        });
+    }
+
+    // Definitions are retired in walk order so combined outputs are stable,
+    // holding back any that arrive early
+    std::string shard_file;
+    std::vector<EncodedFileJob> early_jobs(in_shard_job_indices.size());
+    std::vector<bool> early_job_ready(early_jobs.size());
+
+    if (sharded && !header_only) {
+        shard_file = sink.AcquireBuffer();
+        shard_file.append(source_preamble);
+    }
+
+    // Packs hold the header, the index sorted by path and the path pool,
+    // then every file: those in the layout profile in its order, the rest in
+    // walk order. The front is filled in last, once every file's offset is
+    // known.
+    std::string pack_file;
+    std::vector<PackFileEntry> pack_entries(options.pack ? jobs.size() : 0);
+    uint64_t pack_path_pool_size = 0;
+
+    if (options.pack) {
+        for (const auto& job : jobs) {
+            pack_path_pool_size += job.relative_path.size();
+        }
+
+        const uint64_t index_offset = AlignUp(sizeof(PackFileHeader), alignof(PackFileEntry));
+        const uint64_t data_offset = index_offset + jobs.size() * sizeof(PackFileEntry) + pack_path_pool_size;
+
+        pack_file = sink.AcquireBuffer();
+        pack_file.resize(AlignUp(data_offset, page_size));
+    }
+
+    auto recycle_text = [&](std::string& text) {
+        if (text.capacity() <= max_pooled_buffer_size) {
+            text.clear();
+            text_buffer_pool.TryPush(text);
+        }
+    };
+
+    auto write_output = [&](std::string_view path, std::string contents) {
+        success &= sink.WriteFile(path, std::move(contents));
+        result->output_paths.push_back(path);
+    };
+
+    for (size_t i = 0; i < in_shard_job_indices.size(); ++i) {
+        EncodedFileJob encoded_job = encoded_queue.Pop();
+        success &= encoded_job.success;
+
+        const size_t pipeline_idx = encoded_job.pipeline_idx;
+        early_jobs[pipeline_idx] = std::move(encoded_job);
+        early_job_ready[pipeline_idx] = true;
+
+        size_t retired = next_definition_idx.load(std::memory_order_relaxed);
+
+        for (; retired < early_jobs.size() && early_job_ready[retired]; ++retired) {
+            EncodedFileJob& ready_job = early_jobs[retired];
+            const FileJob& job = jobs[in_shard_job_indices[retired]];
+
+            if (options.pack) {
+                auto& file_data = ready_job.file_data;
+                const bool page_aligned = options.page_align_file_size > 0 && file_data.size() >= options.page_align_file_size;
+                const uint64_t alignment = file_data.size() >= page_size || page_aligned ? page_size : pack_small_file_alignment;
+
+                pack_file.resize(AlignUp(pack_file.size(), alignment));
+                pack_entries[in_shard_job_indices[retired]] = { pack_file.size(), file_data.size() };
+                pack_file.append((const char*)file_data.data(), file_data.size());
+
+                // Not counted in the entry's size
+                if (job.nul_terminated) {
+                    pack_file.push_back('\0');
+                }
+
+                // Nothing else shares the last page, so it can be released too
+                if (page_aligned) {
+                    pack_file.resize(AlignUp(pack_file.size(), page_size));
+                }
+
+                if (file_data.capacity() <= max_pooled_buffer_size) {
+                    file_data.clear();
+                    file_buffer_pool.TryPush(file_data);
+                }
+                continue;
+            }
+
+            if (job.route == FileRoute::BULK) {
+                write_output(arena.CopyString(ready_job.raw_path), std::move(ready_job.data));
+
+                if (options.bulk_fallback) {
+                    write_output(arena.Concat({ job.relative_path, ".inc" }), std::move(ready_job.initializer));
+                }
+            }
+
+            if (sharded) {
+                shard_file.append("\n").append(ready_job.text);
+                recycle_text(ready_job.text);
+                continue;
+            }
+
+            switch (job.route) {
+            case FileRoute::SOURCE:
+                write_output(arena.Concat({ job.relative_path, ".cpp" }), std::move(ready_job.text));
+                break;
+
+            case FileRoute::BATCHED: {
+                Batch& batch = batches[job.batch_idx];
+
+                if (batch.text.empty()) {
+                    batch.text = sink.AcquireBuffer();
+                    batch.text.append(source_preamble);
+                }
+
+                batch.text.append("\n").append(ready_job.text);
+                recycle_text(ready_job.text);
+
+                if (retired == batch.last_pipeline_idx) {
+                    batch.text.append(source_epilogue);
+                    write_output(batch.path, std::move(batch.text));
+                }
+                break;
+            }
+
+            case FileRoute::BULK:
+                write_output(arena.Concat({ job.relative_path, ".cpp" }), std::move(ready_job.text));
+                break;
+            }
+        }
+
+        next_definition_idx.store(retired);
+        next_definition_idx.notify_all();
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    result->minified_file_count = minified_file_count;
+    result->minified_bytes_saved = minified_bytes_saved;
+    result->gzipped_file_count = gzipped_file_count;
+    result->gzipped_bytes_saved = gzipped_bytes_saved;
+
+    if (sharded && !header_only) {
+        shard_file.append(source_epilogue);
+        write_output(arena.Concat({ "bin_", std::to_string(options.shard_index), ".cpp" }), std::move(shard_file));
+    }
+
+    // Both the compiled index and the pack list files by path
+    std::vector<const FileJob*> sorted_jobs;
+
+    if (options.generate_index || options.pack) {
+        sorted_jobs.reserve(jobs.size());
+
+        for (const auto& job : jobs) {
+            sorted_jobs.push_back(&job);
+        }
+
+        std::sort(sorted_jobs.begin(), sorted_jobs.end(), [](const FileJob* a, const FileJob* b) {
+            return a->relative_path < b->relative_path;
+        });
+    }
+
+    if (options.pack) {
+        PackFileHeader header;
+        header.alignment = (uint32_t)page_size;
+        header.file_count = jobs.size();
+        header.index_offset = AlignUp(sizeof(PackFileHeader), alignof(PackFileEntry));
+        header.path_pool_offset = header.index_offset + jobs.size() * sizeof(PackFileEntry);
+        header.path_pool_size = pack_path_pool_size;
+        header.pack_size = pack_file.size();
+
+        memcpy(pack_file.data(), &header, sizeof(header));
+
+        char* index = pack_file.data() + header.index_offset;
+        char* path_pool = pack_file.data() + header.path_pool_offset;
+        uint32_t path_offset = 0;
+
+        for (const FileJob* job : sorted_jobs) {
+            PackFileEntry entry = pack_entries[job - jobs.data()];
+            entry.path_offset = path_offset;
+            entry.path_size = (uint32_t)job->relative_path.size();
+
+            memcpy(index, &entry, sizeof(entry));
+            index += sizeof(entry);
+
+            memcpy(path_pool + path_offset, job->relative_path.data(), job->relative_path.size());
+            path_offset += entry.path_size;
+        }
+
+        write_output("bin.pack", std::move(pack_file));
+
+        std::string pack_source_file = sink.AcquireBuffer();
+        pack_source_file.append("// AUTOGENERATED\n\n#include \"bin.h\"\n").append(map_file_includes);
+
+        pack_source_file.append("\nnamespace ").append(options.root_namespace).append("::dir2src {\n\nnamespace {\n\nconst char* pack_path = ");
+        AppendStringLiteral(&pack_source_file, options.pack_runtime_path);
+        pack_source_file.append(";\n").append(map_file_source).append(pack_source).append("\n}\n");
+
+        write_output("bin_pack.cpp", std::move(pack_source_file));
+    }
+
+    if (write_header) {
+        std::string header_file = sink.AcquireBuffer();
+        header_file.append(R"(// AUTOGENERATED
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+)");
+
+        if (options.generate_index || options.pack) {
+            header_file.append(R"(
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <utility>
+)");
+        }
+
+        const bool any_nul_terminated = std::any_of(jobs.begin(), jobs.end(), [](const FileJob& job) {
+            return job.nul_terminated;
+        });
+
+        if (any_nul_terminated && !options.pack) {
+            header_file.append("\n");
+            AppendNulTerminatedArray(&header_file, options.root_namespace);
+        }
+
+        if (dev_accessors) {
+            header_file.append(R"(
+#if defined(DIR2SRC_DEV)
+#include <atomic>
+#include <cstddef>
+#include <string_view>
+#endif
+)");
+        }
+
+        if (options.page_align_file_size > 0) {
+            header_file.append("\n#include <cstddef>\n\nnamespace ").append(options.root_namespace).append("::dir2src {\n");
+            header_file.append(release_header).append("\n}\n");
+
+            std::string release_source_file = sink.AcquireBuffer();
+            release_source_file.append("// AUTOGENERATED\n\n#include \"bin.h\"\n").append(map_file_includes);
+            release_source_file.append("\nnamespace ").append(options.root_namespace).append("::dir2src {\n");
+            release_source_file.append(release_source);
+
+            if (compression) {
+                release_source_file.append(compressed_release_source);
+            }
+
+            release_source_file.append("\n}\n");
+
+            success &= sink.WriteFile("bin_release.cpp", std::move(release_source_file));
+            result->output_paths.insert(result->output_paths.begin(), "bin_release.cpp");
+        }
+
+        if (checksums) {
+            header_file.append("\n#include <cstddef>\n\nnamespace ").append(options.root_namespace).append("::dir2src {\n");
+            header_file.append(checksum_header).append("\n}\n");
+
+            std::string checksum_source_file = sink.AcquireBuffer();
+            checksum_source_file.append("// AUTOGENERATED\n\n#include \"bin.h\"\n").append(checksum_includes);
+            checksum_source_file.append("\nnamespace ").append(options.root_namespace).append("::dir2src {\n");
+            checksum_source_file.append(checksum_source);
+
+            if (compression) {
+                checksum_source_file.append(compressed_checksum_source);
+            }
+
+            checksum_source_file.append("\n}\n");
+
+            success &= sink.WriteFile("bin_checksum.cpp", std::move(checksum_source_file));
+            result->output_paths.insert(result->output_paths.begin(), "bin_checksum.cpp");
+        }
+
+        if (http_metadata) {
+            header_file.append("\n#include <string_view>\n\nnamespace ").append(options.root_namespace).append("::dir2src {\n");
+            header_file.append(http_header).append("\n}\n");
+        }
+
+        if (compression) {
+            header_file.append("\n");
+            AppendCompressedResource(&header_file, options.root_namespace);
+
+            header_file.append("\n#include <cstring>\n\nnamespace ").append(options.root_namespace).append("::dir2src {\n");
+            header_file.append("\n// Each has a slot in the decoded cache\ninline constexpr size_t compressed_file_count = ");
+            AppendNumber(&header_file, compressed_file_count);
+            header_file.append(";\n").append(compressed_header);
+
+            if (options.page_align_file_size > 0) {
+                header_file.append(compressed_release_header);
+            }
+
+            if (checksums) {
+                header_file.append(compressed_checksum_header);
+            }
+
+            header_file.append("\n}\n");
+
+            std::string compressed_source_file = sink.AcquireBuffer();
+            compressed_source_file.append("// AUTOGENERATED\n\n#include \"bin.h\"\n").append(compressed_includes);
+            compressed_source_file.append("\nnamespace ").append(options.root_namespace).append("::dir2src {\n");
+            compressed_source_file.append(instrument ? compressed_profiled_hooks : compressed_unprofiled_hooks);
+            compressed_source_file.append(compressed_source).append("\n}\n");
+
+            success &= sink.WriteFile("bin_compressed.cpp", std::move(compressed_source_file));
+            result->output_paths.insert(result->output_paths.begin(), "bin_compressed.cpp");
+        }
+
+        // Of each job, its file's position in the index, for the named
+        // files' counters
+        std::vector<size_t> index_of_job(instrument ? jobs.size() : 0);
+
+        for (size_t i = 0; i < index_of_job.size(); ++i) {
+            index_of_job[sorted_jobs[i] - jobs.data()] = i;
+        }
+
+        // Find(), File::Bytes() and the named files count accesses
+        if (instrument) {
+            header_file.append("\n#include <atomic>\n#include <cstddef>\n\nnamespace ").append(options.root_namespace).append("::dir2src {\n");
+            header_file.append(profile_header).append("\n}\n");
+
+            std::string profile_source_file = sink.AcquireBuffer();
+            profile_source_file.append("// AUTOGENERATED\n\n#include \"bin.h\"\n").append(profile_includes);
+            profile_source_file.append("\nnamespace ").append(options.root_namespace).append("::dir2src {\n\nnamespace detail {\n\n");
+            profile_source_file.append("AccessCounters access_counters[file_count > 0 ? file_count : 1];\n");
+
+            // Compressed files are profiled by cache slot
+            if (compression) {
+                std::vector<size_t> compressed_file_indices(compressed_file_count);
+
+                for (size_t i = 0; i < sorted_jobs.size(); ++i) {
+                    if (sorted_jobs[i]->compressed) compressed_file_indices[sorted_jobs[i]->cache_idx] = i;
+                }
+
+                profile_source_file.append("\nextern const uint32_t compressed_file_indices[] = {\n   ");
+
+                for (size_t i = 0; i < compressed_file_indices.size(); ++i) {
+                    profile_source_file.append(i > 0 && i % 12 == 0 ? "\n    " : " ");
+                    AppendNumber(&profile_source_file, compressed_file_indices[i]);
+                    profile_source_file.append(",");
+                }
+
+                profile_source_file.append(compressed_file_indices.empty() ? " 0\n};\n" : "\n};\n");
+            }
+
+            profile_source_file.append("\n} // namespace detail\n").append(profile_source).append("\n}\n");
+
+            success &= sink.WriteFile("bin_profile.cpp", std::move(profile_source_file));
+            result->output_paths.insert(result->output_paths.begin(), "bin_profile.cpp");
+        }
+
+        // Resources name the lookups, so those come first
+        if (options.pack) {
+            header_file.append("\nnamespace ").append(options.root_namespace).append("::dir2src {\n");
+            header_file.append(index_header_types).append(index_header_file_bytes).append(index_header_entry);
+            header_file.append(pack_header_runtime).append(index_header_lookups);
+            header_file.append(index_header_find).append(index_header_listings).append(pack_header_resource);
+            header_file.append("\n}\n");
+        }
+
+        // Each file as a Resource for packs and dev builds, as its std::array
+        // otherwise
+        auto append_declarations = [&](bool resources) {
+            header_file.append("\nnamespace ").append(options.root_namespace).append(" {\n\n");
+
+            std::span<std::string_view> header_namespaces;
+
+            for (const auto& job : jobs) {
+                const auto& namespaces = job.namespaces;
+
+                // Populate namespaces for header
+                size_t common_namespaces = 0;
+                while (common_namespaces < header_namespaces.size() &&
+                       common_namespaces < namespaces.size() &&
+                       header_namespaces[common_namespaces] == namespaces[common_namespaces]) {
+                    ++common_namespaces;
+                }
+
+                for (size_t i = common_namespaces; i < header_namespaces.size(); ++i) {
+                    header_file.append("\n}\n");
+                }
+
+                for (size_t i = common_namespaces; i < namespaces.size(); ++i) {
+                    header_file.append("\nnamespace ").append(namespaces[i]).append(" {\n\n");
+                }
+
+                header_namespaces = namespaces;
+
+                if (resources) {
+                    header_file.append(options.pack ? "inline constexpr ::" : "inline const ::");
+                    header_file.append(options.root_namespace).append("::dir2src::Resource ");
+                    header_file.append(job.defined_name).append("{ ");
+                    AppendStringLiteral(&header_file, job.relative_path);
+                    header_file.append(job.nul_terminated && !options.pack ? ", true };\n" : " };\n");
+                }
+                else if (job.compressed) {
+                    header_file.append("extern const ::").append(options.root_namespace).append("::dir2src::CompressedResource ");
+                    header_file.append(job.array_name).append(";\n");
+                }
+                else {
+                    if (job.nul_terminated) {
+                        header_file.append("extern ::").append(options.root_namespace).append("::dir2src::NulTerminatedArray<");
+                    }
+                    else {
+                        header_file.append("extern std::array<uint8_t, ");
+                    }
+
+                    AppendNumber(&header_file, job.size);
+                    header_file.append("> ").append(job.defined_name).append(";\n");
+                }
+
+                // Counts each read of the bytes just declared
+                if (job.defined_name != job.array_name) {
+                    header_file.append("inline constexpr ::").append(options.root_namespace).append("::dir2src::ProfiledResource ");
+                    header_file.append(job.array_name).append("{ ").append(job.defined_name).append(", ");
+                    AppendNumber(&header_file, index_of_job[&job - jobs.data()]);
+                    header_file.append(" };\n");
+                }
+
+                // Of the generated bytes, which dev builds' files may no
+                // longer hold
+                if (checksums) {
+                    char checksum[11];
+                    snprintf(checksum, sizeof(checksum), "0x%08X", (unsigned)job.checksum);
+
+                    header_file.append("inline constexpr uint32_t ").append(job.array_name).append("_crc32c = ");
+                    header_file.append(checksum).append(";\n");
+                }
+
+                if (http_metadata) {
+                    char etag[19];
+                    snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long)job.content_hash);
+
+                    header_file.append("inline constexpr ::").append(options.root_namespace).append("::dir2src::HttpMetadata ");
+                    header_file.append(job.array_name).append("_http{ ");
+                    AppendStringLiteral(&header_file, etag);
+                    header_file.append(", ");
+                    AppendStringLiteral(&header_file, job.content_type);
+                    header_file.append(", ");
+                    const int64_t modified_time = options.source_date_epoch >= 0
+                        ? std::min(job.modified_time, options.source_date_epoch)
+                        : job.modified_time;
+
+                    AppendNumber(&header_file, (uint64_t)std::max<int64_t>(modified_time, 0));
+                    header_file.append(", ");
+                    AppendHttpDate(&header_file, modified_time);
+
+                    // Of the gzip's own bytes, suffixed so it can never
+                    // match the identity ETag. Dev builds' gzips are empty.
+                    // Always spelled, for -Wmissing-field-initializers.
+                    char gzip_etag[22] = "";
+
+                    if (gzip && job.gzip_size > 0 && !resources) {
+                        snprintf(gzip_etag, sizeof(gzip_etag), "\"%016llx-gz\"", (unsigned long long)job.gzip_hash);
+                    }
+
+                    header_file.append(", ");
+                    AppendStringLiteral(&header_file, gzip_etag);
+
+                    header_file.append(" };\n");
+                }
+
+                // Dev builds compile no sources to define it in
+                if (gzip && job.gzip_size > 0 && !resources) {
+                    header_file.append("extern const std::array<uint8_t, ");
+                    AppendNumber(&header_file, job.gzip_size);
+                    header_file.append("> ").append(job.array_name).append("_gz;\n");
+                }
+                else if (gzip) {
+                    header_file.append("inline constexpr std::array<uint8_t, 0> ").append(job.array_name).append("_gz{};\n");
+                }
+            }
+
+            for (size_t i = 0; i < header_namespaces.size() + 1; ++i) {
+                header_file.append("\n}\n");
+            }
+        };
+
+        if (dev_accessors) {
+            header_file.append("\n#if defined(DIR2SRC_DEV)\n");
+            header_file.append("\nnamespace ").append(options.root_namespace).append("::dir2src {\n");
+            header_file.append(dev_header_resource);
+            header_file.append("\n}\n");
+
+            append_declarations(true);
+
+            header_file.append("\n#else\n");
+            append_declarations(false);
+            header_file.append("\n#endif\n");
+        }
+        else {
+            append_declarations(options.pack);
+        }
+
+        if (dev_accessors) {
+            std::string dev_source_file = sink.AcquireBuffer();
+            dev_source_file.append("// AUTOGENERATED\n\n#if defined(DIR2SRC_DEV)\n\n#include \"bin.h\"\n\n#include <string>\n");
+            dev_source_file.append(map_file_includes);
+
+            dev_source_file.append("\nnamespace ").append(options.root_namespace).append("::dir2src {\n\nnamespace {\n\nconst char* source_root = ");
+            AppendStringLiteral(&dev_source_file, options.dev_source_root);
+            dev_source_file.append(";\n").append(map_file_source).append(dev_source).append("\n}\n\n#endif\n");
+
+            success &= sink.WriteFile("bin_dev.cpp", std::move(dev_source_file));
+            result->output_paths.insert(result->output_paths.begin(), "bin_dev.cpp");
+        }
+
+        if (options.generate_index && !options.pack) {
+            header_file.append("\nnamespace ").append(options.root_namespace).append("::dir2src {\n\n");
+            header_file.append("inline constexpr size_t file_count = ");
+            AppendNumber(&header_file, jobs.size());
+            header_file.append(";\n");
+            header_file.append(index_header_types);
+
+            if (compression) {
+                header_file.append(index_header_compressed_file);
+            }
+
+            header_file.append(instrument ? index_header_profiled_file : index_header_file_bytes);
+            header_file.append(index_header_entry).append(index_header_tables);
+
+            auto append_embedded_files = [&]() {
+                header_file.append(compression ? index_header_embedded_compressed_files : index_header_embedded_files);
+                header_file.append(index_header_embedded_file_at).append(compression ? ", file_compressed[idx]" : "");
+                header_file.append(instrument ? ", idx };\n}\n" : " };\n}\n");
+            };
+
+            if (dev_accessors) {
+                header_file.append("\n#if defined(DIR2SRC_DEV)\n").append(index_header_dev_files);
+                header_file.append(compression && instrument ? ", nullptr" : "");
+                header_file.append(instrument ? ", idx };\n}\n" : " };\n}\n");
+                header_file.append("\n#else\n");
+                append_embedded_files();
+                header_file.append("\n#endif\n");
+            }
+            else {
+                append_embedded_files();
+            }
+
+            header_file.append("\n} // namespace detail\n").append(index_header_lookups);
+            header_file.append(instrument ? index_header_profiled_find : index_header_find).append(index_header_listings);
+            header_file.append("\n}\n");
+
+            std::string index_file = sink.AcquireBuffer();
+            index_file.append("// AUTOGENERATED\n\n#include \"bin.h\"\n\nnamespace ");
+            index_file.append(options.root_namespace).append("::dir2src::detail {\n\n");
+
+            index_file.append("const std::array<uint32_t, file_count + 1> path_offsets = {\n    0");
+
+            std::vector<uint8_t> path_pool;
+            for (size_t i = 0; i < sorted_jobs.size(); ++i) {
+                const auto& path = sorted_jobs[i]->relative_path;
+                path_pool.insert(path_pool.end(), path.begin(), path.end());
+
+                index_file.append((i + 1) % 12 == 0 ? ",\n    " : ", ");
+                AppendNumber(&index_file, path_pool.size());
+            }
+
+            // Never empty, arrays can't be
+            if (path_pool.empty()) path_pool.push_back(0);
+
+            index_file.append("\n};\n\nconst uint8_t path_pool[] = {\n");
+            AppendByteLiterals(&index_file, path_pool, hex_format);
+
+            index_file.append("\n};\n");
+
+            auto append_file_name = [&](std::string_view prefix, const FileJob* job) {
+                index_file.append(prefix).append("::").append(options.root_namespace).append("::");
+
+                for (auto n : job->namespaces) {
+                    index_file.append(n).append("::");
+                }
+
+                index_file.append(job->defined_name);
+            };
+
+            if (dev_accessors) {
+                index_file.append("\n#if defined(DIR2SRC_DEV)\n");
+                index_file.append("\nconst std::array<const Resource*, file_count> file_resources = {\n");
+                for (const FileJob* job : sorted_jobs) {
+                    append_file_name("    &", job);
+                    index_file.append(",\n");
+                }
+                index_file.append("};\n\n#else\n");
+            }
+
+            // Compressed files have no bytes to point at
+            index_file.append("\nconst std::array<const uint8_t*, file_count> file_data = {\n");
+            for (const FileJob* job : sorted_jobs) {
+                if (job->compressed) {
+                    index_file.append("    nullptr,\n");
+                    continue;
+                }
+
+                append_file_name("    ", job);
+                index_file.append(".data(),\n");
+            }
+
+            index_file.append("};\n\nconst std::array<size_t, file_count> file_sizes = {\n");
+            for (const FileJob* job : sorted_jobs) {
+                index_file.append("    ");
+                AppendNumber(&index_file, job->size);
+                index_file.append(",\n");
+            }
+
+            if (compression) {
+                index_file.append("};\n\nconst std::array<const CompressedResource*, file_count> file_compressed = {\n");
+                for (const FileJob* job : sorted_jobs) {
+                    if (job->compressed) {
+                        append_file_name("    &", job);
+                        index_file.append(",\n");
+                    }
+                    else {
+                        index_file.append("    nullptr,\n");
+                    }
+                }
+            }
+
+            index_file.append(dev_accessors ? "};\n\n#endif\n\n}\n" : "};\n\n}\n");
+
+            success &= sink.WriteFile("bin_index.cpp", std::move(index_file));
+            result->output_paths.insert(result->output_paths.begin(), "bin_index.cpp");
+        }
+
+        // The profiled resources' symbols in rank order, for ELF linkers
+        // that take a symbol ordering file (lld's --symbol-ordering-file)
+        if (!layout_ranks.empty() && !options.pack && !header_only) {
+            std::vector<const FileJob*> ranked_jobs;
+
+            for (const auto& job : jobs) {
+                if (job.layout_rank != no_layout_rank) ranked_jobs.push_back(&job);
+            }
+
+            std::sort(ranked_jobs.begin(), ranked_jobs.end(), [](const FileJob* a, const FileJob* b) {
+                return a->layout_rank < b->layout_rank;
+            });
+
+            std::string order_file = sink.AcquireBuffer();
+
+            // A compressed file's descriptor is elsewhere, only its chunks
+            // are in its section
+            for (const FileJob* job : ranked_jobs) {
+                if (job->compressed) {
+                    AppendMangledName(&order_file, options.root_namespace, job->namespaces, std::string(job->array_name).append("_chunk_data"));
+                }
+                else {
+                    AppendMangledName(&order_file, options.root_namespace, job->namespaces, job->defined_name);
+                }
+                order_file.append("\n");
+            }
+
+            success &= sink.WriteFile("bin.order", std::move(order_file));
+            result->output_paths.push_back("bin.order");
+        }
+
+        // The same declarations exported from a C++20 module, with a
+        // partition per top-level directory. Each unit includes bin.h in its
+        // global module fragment and exports using-declarations, so importers
+        // and includers name the entities the generated sources define.
+        if (!options.module_name.empty()) {
+            auto begin_module_unit = [&](std::string_view partition) {
+                std::string unit = sink.AcquireBuffer();
+                unit.append("// AUTOGENERATED\n\nmodule;\n\n#include \"bin.h\"\n\nexport module ");
+                unit.append(options.module_name);
+                if (!partition.empty()) unit.append(":").append(partition);
+                unit.append(";\n");
+                return unit;
+            };
+
+            auto append_file_exports = [&](std::string& unit, std::span<const FileJob> file_jobs) {
+                unit.append("\nexport namespace ").append(options.root_namespace).append(" {\n\n");
+
+                std::span<const std::string_view> unit_namespaces;
+
+                for (const auto& job : file_jobs) {
+                    size_t common_namespaces = 0;
+                    while (common_namespaces < unit_namespaces.size() &&
+                           common_namespaces < job.namespaces.size() &&
+                           unit_namespaces[common_namespaces] == job.namespaces[common_namespaces]) {
+                        ++common_namespaces;
+                    }
+
+                    for (size_t i = common_namespaces; i < unit_namespaces.size(); ++i) {
+                        unit.append("\n}\n");
+                    }
+
+                    for (size_t i = common_namespaces; i < job.namespaces.size(); ++i) {
+                        unit.append("\nnamespace ").append(job.namespaces[i]).append(" {\n\n");
+                    }
+
+                    unit_namespaces = job.namespaces;
+
+                    for (auto [suffix, declared] : { std::pair{ "", true }, std::pair{ "_crc32c", checksums }, std::pair{ "_http", http_metadata }, std::pair{ "_gz", gzip } }) {
+                        if (!declared) continue;
+
+                        unit.append("using ::").append(options.root_namespace);
+                        for (auto n : job.namespaces) {
+                            unit.append("::").append(n);
+                        }
+                        unit.append("::").append(job.array_name).append(suffix).append(";\n");
+                    }
+                }
+
+                for (size_t i = 0; i < unit_namespaces.size() + 1; ++i) {
+                    unit.append("\n}\n");
+                }
+            };
+
+            // Every top-level directory gets a partition, even one without
+            // files, so build systems can list them from the input root
+            std::map<std::string_view, std::string> partition_units;
+
+            for (auto name : top_level_directory_names) {
+                if (!partition_units.contains(name)) {
+                    partition_units.emplace(name, begin_module_unit(name));
+                }
+            }
+
+            // In walk order the root's files come first, then each top-level
+            // directory's together
+            size_t root_file_count = 0;
+            while (root_file_count < jobs.size() && jobs[root_file_count].namespaces.empty()) {
+                ++root_file_count;
+            }
+
+            for (size_t first = root_file_count; first < jobs.size();) {
+                size_t last = first + 1;
+                while (last < jobs.size() && jobs[last].namespaces[0] == jobs[first].namespaces[0]) {
+                    ++last;
+                }
+
+                append_file_exports(partition_units[jobs[first].namespaces[0]], std::span(jobs).subspan(first, last - first));
+                first = last;
+            }
+
+            std::string primary_unit = begin_module_unit({});
+            primary_unit.append("\n");
+
+            for (const auto& [name, unit] : partition_units) {
+                primary_unit.append("export import :").append(name).append(";\n");
+            }
+
+            std::vector<std::string_view> runtime_names;
+
+            if (any_nul_terminated && !options.pack) {
+                runtime_names.push_back("NulTerminatedArray");
+            }
+
+            if (options.generate_index || options.pack) {
+                runtime_names.insert(runtime_names.end(), {
+                    "File", "DirectoryEntry", "FileRange", "DirectoryListing", "Find", "Files", "FilesUnder", "ListDirectory",
+                });
+            }
+
+            if (options.generate_index && !options.pack) {
+                runtime_names.push_back("file_count");
+            }
+
+            if (options.pack) {
+                runtime_names.insert(runtime_names.end(), { "Resource", "SetPackPath", "PackLoaded" });
+            }
+
+            if (options.page_align_file_size > 0) {
+                runtime_names.push_back("Release");
+            }
+
+            if (checksums) {
+                runtime_names.insert(runtime_names.end(), { "Crc32c", "Verify" });
+            }
+
+            if (http_metadata) {
+                runtime_names.push_back("HttpMetadata");
+            }
+
+            if (instrument) {
+                runtime_names.insert(runtime_names.end(), { "ProfiledResource", "WriteAccessProfile" });
+            }
+
+            if (compression) {
+                runtime_names.insert(runtime_names.end(), {
+                    "CompressedResource", "DecodeChunk", "ReadAt", "Decode", "DecodedResource", "Decoded", "SetDecodedCacheBudget",
+                    "compressed_file_count",
+                });
+            }
+
+            if (!runtime_names.empty() || dev_accessors) {
+                primary_unit.append("\nexport namespace ").append(options.root_namespace).append("::dir2src {\n\n");
+
+                for (auto name : runtime_names) {
+                    primary_unit.append("using ::").append(options.root_namespace).append("::dir2src::").append(name).append(";\n");
+                }
+
+                if (dev_accessors) {
+                    primary_unit.append("\n#if defined(DIR2SRC_DEV)\nusing ::").append(options.root_namespace);
+                    primary_unit.append("::dir2src::Resource;\n#endif\n");
+                }
+
+                primary_unit.append("\n}\n");
+            }
+
+            if (root_file_count > 0) {
+                append_file_exports(primary_unit, std::span(jobs).first(root_file_count));
+            }
+
+            success &= sink.WriteFile("bin.cppm", std::move(primary_unit));
+
+            std::vector<std::string_view> module_paths{ "bin.cppm" };
+
+            for (auto& [name, unit] : partition_units) {
+                module_paths.push_back(arena.Concat({ "bin-", name, ".cppm" }));
+                success &= sink.WriteFile(module_paths.back(), std::move(unit));
+            }
+
+            result->output_paths.insert(result->output_paths.begin(), module_paths.begin(), module_paths.end());
+        }
+
+        success &= sink.WriteFile("bin.h", std::move(header_file));
+        result->output_paths.insert(result->output_paths.begin(), "bin.h");
+    }
+
+    success &= sink.Flush();
+
+    return success;
+}
+
+void MemoryFileSource::AddFile(std::string file_path, std::vector<uint8_t> data) {
+    files[std::move(file_path)] = std::move(data);
+}
+
+bool MemoryFileSource::ListDirectory(std::string_view directory_path, const DirectoryVisitor& visit) {
+    std::string prefix(directory_path);
+    if (!prefix.empty()) {
+        prefix.push_back('/');
+    }
+
+    // Keys under the prefix are contiguous; each subdirectory's keys are
+    // skipped in one lookup
+    auto it = files.lower_bound(prefix);
+    while (it != files.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+        std::string_view name = std::string_view(it->first).substr(prefix.size());
+        size_t separator_idx = name.find('/');
+
+        if (separator_idx == std::string_view::npos) {
+            visit({ name, false, it->second.size() });
+            ++it;
+        }
+        else {
+            std::string_view subdirectory_name = name.substr(0, separator_idx);
+            visit({ subdirectory_name, true, 0 });
+
+            // '0' sorts directly after '/'
+            it = files.lower_bound(prefix + std::string(subdirectory_name) + "0");
+        }
+    }
+
+    return true;
+}
+
+bool MemoryFileSource::ReadFile(std::string_view file_path, std::vector<uint8_t>* output_buffer) {
+    auto it = files.find(file_path);
+    if (it == files.end()) {
+        return false;
+    }
+
+    output_buffer->assign(it->second.begin(), it->second.end());
+    return true;
+}
+
+bool MemoryOutputSink::WriteFile(std::string_view file_path, std::string contents) {
+    files[std::string(file_path)] = std::move(contents);
+    return true;
+}
+
+DiskFileSource::DiskFileSource(std::string root_path)
+    : root_path(NormalizeDirectoryString(std::move(root_path))) {}
+
+std::string DiskFileSource::DiskPath(std::string_view path) const {
+    std::string disk_path;
+    AppendDiskPath(&disk_path, root_path, path);
+
+    return disk_path;
+}
+
+bool DiskFileSource::ListDirectory(std::string_view directory_path, const DirectoryVisitor& visit) {
+    std::string search_path = NormalizeDirectoryString(DiskPath(directory_path)) + "*";
+
+    WIN32_FIND_DATA find_data = {};
+    HANDLE h_find_file = ::FindFirstFile(search_path.c_str(), &find_data);
+
+    if (h_find_file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Failed to list input directory: %lu\n", GetLastError());
+        return false;
+    }
+
+    do {
+        if (!strcmp(find_data.cFileName, ".") ||
+            !strcmp(find_data.cFileName, "..")) {
+            continue;
+        }
+
+        visit({
+            find_data.cFileName,
+            (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0,
+            ((uint64_t)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow,
+            UnixTime(find_data.ftLastWriteTime),
+        });
+    } while (::FindNextFile(h_find_file, &find_data));
+
+    ::FindClose(h_find_file);
+    return true;
+}
+
+bool DiskFileSource::ReadFile(std::string_view file_path, std::vector<uint8_t>* output_buffer) {
+    // One per reader thread, so steady-state reads don't allocate
+    thread_local std::string disk_path;
+    AppendDiskPath(&disk_path, root_path, file_path);
+
+    return ReadDiskFile(disk_path, output_buffer);
+}
+
+DiskOutputSink::DiskOutputSink(std::string root_path, bool restat, size_t write_threads)
+    : root_path(NormalizeDirectoryString(std::move(root_path))), restat(restat) {
+
+    for (size_t i = 0; i < write_threads; ++i) {
+        writer_threads.emplace_back(&DiskOutputSink::WriterThread, this);
+    }
+}
+
+DiskOutputSink::~DiskOutputSink() {
+    Flush();
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_not_empty.notify_all();
+
+    for (auto& writer_thread : writer_threads) {
+        writer_thread.join();
+    }
+}
+
+std::string DiskOutputSink::DiskPath(std::string_view path) const {
+    std::string disk_path;
+    AppendDiskPath(&disk_path, root_path, path);
+
+    return disk_path;
+}
+
+bool DiskOutputSink::WriteFile(std::string_view file_path, std::string contents) {
+    if (writer_threads.empty()) {
+        thread_local std::string disk_path;
+        AppendDiskPath(&disk_path, root_path, file_path);
+
+        bool success = WriteNow(disk_path, contents);
+
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        RecycleBuffer(std::move(contents));
+
+        return success;
+    }
+
+    // Bounds memory held by queued outputs when generation outpaces the disk
+    constexpr size_t max_queued_bytes = 64 << 20;
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_drained.wait(lock, [&] {
+        return queued_bytes == 0 || queued_bytes + contents.size() <= max_queued_bytes;
+    });
+
+    PendingWrite pending_write;
+
+    if (!spare_paths.empty()) {
+        pending_write.disk_path = std::move(spare_paths.back());
+        spare_paths.pop_back();
+    }
+
+    AppendDiskPath(&pending_write.disk_path, root_path, file_path);
+    pending_write.contents = std::move(contents);
+
+    queued_bytes += pending_write.contents.size();
+    queue.push_back(std::move(pending_write));
+
+    lock.unlock();
+    queue_not_empty.notify_one();
+
+    return true;
+}
+
+bool DiskOutputSink::Flush() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_drained.wait(lock, [&] { return queue_head == queue.size() && writes_in_flight == 0; });
+
+    bool success = !write_failed;
+    write_failed = false;
+
+    return success;
+}
+
+std::string DiskOutputSink::AcquireBuffer() {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+
+    if (spare_buffers.empty()) {
+        return {};
+    }
+
+    std::string buffer = std::move(spare_buffers.back());
+    spare_buffers.pop_back();
+
+    return buffer;
+}
+
+void DiskOutputSink::RecycleBuffer(std::string buffer) {
+    constexpr size_t max_spare_buffers = 64;
+
+    if (spare_buffers.size() < max_spare_buffers && buffer.capacity() <= max_pooled_buffer_size) {
+        buffer.clear();
+        spare_buffers.push_back(std::move(buffer));
+    }
+}
+
+bool DiskOutputSink::WriteNow(const std::string& disk_path, std::string_view contents) {
+
+    // Outputs mostly arrive a directory at a time, so the set of created
+    // directories is only consulted when the parent directory changes
+    thread_local std::string last_parent_path;
+
+    std::string_view parent_path = std::string_view(disk_path).substr(0, disk_path.rfind('\\') + 1);
+
+    if (parent_path != last_parent_path) {
+
+        // Create nested output directories
+        for (size_t separator_idx = disk_path.find('\\'); separator_idx < parent_path.size();
+             separator_idx = disk_path.find('\\', separator_idx + 1)) {
+
+            std::string directory_path = disk_path.substr(0, separator_idx + 1);
+
+            std::lock_guard<std::mutex> lock(directories_mutex);
+            if (created_directories.insert(directory_path).second) {
+                ::CreateDirectory(directory_path.c_str(), NULL);
+            }
+        }
+
+        last_parent_path.assign(parent_path);
+    }
+
+    if (restat) return WriteDiskFileIfChanged(disk_path, contents);
+    return WriteDiskFile(disk_path, contents);
+}
+
+void DiskOutputSink::WriterThread() {
+    constexpr size_t write_batch_size = 32;
+
+    std::vector<PendingWrite> batch;
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+
+    while (true) {
+        queue_not_empty.wait(lock, [&] { return stopping || queue_head != queue.size(); });
+
+        if (queue_head == queue.size()) {
+            break;
+        }
+
+        // Take several writes per wakeup so threads don't contend per file
+        while (queue_head != queue.size() && batch.size() < write_batch_size) {
+            batch.push_back(std::move(queue[queue_head++]));
+        }
+
+        // Moved-from entries are dropped once the queue drains, or compacted
+        // away if it never does
+        if (queue_head == queue.size()) {
+            queue.clear();
+            queue_head = 0;
+        }
+        else if (queue_head >= 1024 && queue_head * 2 >= queue.size()) {
+            queue.erase(queue.begin(), queue.begin() + queue_head);
+            queue_head = 0;
+        }
+
+        writes_in_flight += batch.size();
+        lock.unlock();
+
+        bool batch_success = true;
+        size_t batch_bytes = 0;
+
+        for (const auto& pending_write : batch) {
+            batch_success &= WriteNow(pending_write.disk_path, pending_write.contents);
+            batch_bytes += pending_write.contents.size();
+        }
+
+        lock.lock();
+
+        writes_in_flight -= batch.size();
+
+        for (auto& pending_write : batch) {
+            spare_paths.push_back(std::move(pending_write.disk_path));
+            RecycleBuffer(std::move(pending_write.contents));
+        }
+        batch.clear();
+
+        queued_bytes -= batch_bytes;
+        write_failed |= !batch_success;
+
+        queue_drained.notify_all();
+    }
+}
+
+} // namespace dir2src
@@ -0,0 +1,371 @@
+#pragma once
+
+#include "arena.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace dir2src {
+
+// All paths crossing the API are relative to the input or output root and
+// separated by '/'. The root directory itself is "".
+
+enum class Format {
+    ARRAY, // decimal initializers
+    HEX,   // xxd-style hex initializers
+};
+
+struct Options {
+    std::string root_namespace = "Bin";
+    Format format = Format::ARRAY;
+
+    // When shard_count > 0, only files hashing to shard_index are read, and
+    // they are combined into bin_<shard_index>.cpp. Shard 0 writes bin.h.
+    size_t shard_index = 0;
+    size_t shard_count = 0;
+
+    // Files are read, encoded and written by concurrent pipeline stages.
+    // Zero encode threads means one per hardware thread.
+    size_t read_threads = 4;
+    size_t encode_threads = 0;
+
+    // Globs as for .gitignore, see PathFilter. Excluded directories are never
+    // listed, and an exclude starting with '!' brings back files earlier
+    // ones matched. With includes, only files matching one or under a
+    // directory matching one are embedded.
+    std::vector<std::string> include_patterns;
+    std::vector<std::string> exclude_patterns;
+
+    // More exclude patterns, one per line, read from this file in the input
+    // root when it exists. Empty to not look for one.
+    std::string ignore_file_name = ".dir2srcignore";
+
+    // Files matching one of these globs, or under a directory matching one,
+    // are embedded as a NulTerminatedArray: a std::array followed by a NUL
+    // that size() doesn't count, with c_str() and view() for text.
+    std::vector<std::string> nul_terminated_patterns;
+
+    // Files matching one of these globs, or under a directory matching one,
+    // are compressed in independent chunks of compression_chunk_size bytes
+    // and declared as a CompressedResource. ReadAt() then inflates only the
+    // chunks a read touches, Decode() a whole file into the caller's buffer
+    // and Decoded() shares it inflated through a process-wide cache, all
+    // defined in bin_compressed.cpp. Dev builds read the files as they are.
+    // Compressed files aren't NUL-terminated or copied in bulk, and the
+    // index lists them without data. Not for packs, and plans count them
+    // uncompressed.
+    std::vector<std::string> compressed_patterns;
+    uint64_t compression_chunk_size = 64 << 10;
+
+    // Routing by size; zero turns a route off.
+    //
+    // Files of at most small_file_size bytes are combined, in walk order,
+    // into <directory>/bin_small_<n>.cpp of about small_batch_size input
+    // bytes each. Not when sharded, as shards are combined already.
+    //
+    // Files of at least bulk_file_size bytes are copied verbatim, for the
+    // assembler to embed where GNU inline assembly is available: to
+    // <path>.cpp.bin for <path>.cpp, or when sharded to
+    // bin_<n>.cpp.<symbol>.bin for their shard. The stubs find the copies
+    // through __FILE__, or under DIR2SRC_BULK_DIR when that's defined, for
+    // builds that remap __FILE__ with -ffile-prefix-map. Other compilers
+    // stop with an #error, or with bulk_fallback build the usual
+    // initializer from <path>.inc, written alongside. That saves them
+    // nothing, so only ask for it when they must build the same output.
+    uint64_t small_file_size = 0;
+    uint64_t small_batch_size = 1 << 20;
+    uint64_t bulk_file_size = 0;
+    bool bulk_fallback = false;
+
+    // Also writes bin_index.cpp, a sorted index of every file, and adds
+    // <root>::dir2src::Find(), Files(), FilesUnder() and ListDirectory() to
+    // bin.h. The generated index needs C++17.
+    bool generate_index = false;
+
+    // Instead of sources, writes every file to bin.pack and a runtime that
+    // maps it to bin_pack.cpp. bin.h gets the same lookups as the index, and
+    // each file a Resource reading like its embedded std::array, so builds
+    // can switch between the two and a new pack needs no relink.
+    bool pack = false;
+
+    // Where the generated runtime looks for the pack unless told otherwise,
+    // from its working directory when relative. Kept as given, so generated
+    // code only names a build machine's path when asked to.
+    std::string pack_runtime_path = "bin.pack";
+
+    // Also writes bin_dev.cpp, and bin.h declares each file as a Resource
+    // mapped lazily from dev_source_root when DIR2SRC_DEV is defined. The
+    // embedded sources compile to nothing in those builds. Not for packs.
+    bool dev_accessors = false;
+    std::string dev_source_root = ".";
+
+    // Only walks the tree and writes bin.h and its runtimes, for dev builds
+    // that never compile the embedded sources
+    bool header_only = false;
+
+    // Strips comments and insignificant whitespace from text files as they
+    // are read, picked by extension: see minify.h. Dev accessors read the
+    // files as they are.
+    bool minify = false;
+
+    // Paths in the order the program first reads them, e.g. from an access
+    // profile. These files are laid out first and together in that order:
+    // at the front of a pack, or each in a section named for its rank.
+    // MSVC merges those in order; ELF linkers take bin.order, the symbols
+    // in rank order, written along with bin.h.
+    std::vector<std::string> layout_profile;
+
+    // Leaves out the files the layout profile doesn't list. From an
+    // instrumented run's profile, that's every file it didn't find or read,
+    // counted as for instrument, so a listed file only ever read through its
+    // data is left out too: lookups and listings no longer have it.
+    bool prune_unprofiled = false;
+
+    // Files of at least this many bytes start on a page and, in packs and
+    // where the assembler embeds them, are padded to one. bin.h then
+    // declares <root>::dir2src::Release(), which gives a resource's pages
+    // back to the kernel, defined in bin_release.cpp. Zero turns it off.
+    uint64_t page_align_file_size = 0;
+
+    // Declares a CRC-32C of each file's generated bytes in bin.h as
+    // <name>_crc32c, and <root>::dir2src::Crc32c() and Verify() to check a
+    // resource against it, defined in bin_checksum.cpp. Every edit to a file
+    // then rewrites bin.h. Not for packs, which can change without a rebuild.
+    bool checksums = false;
+
+    // Declares an HttpMetadata in bin.h next to each file as <name>_http: a
+    // strong ETag of its generated bytes, its Content-Type, see
+    // ContentTypeOf(), and its modification time as Unix seconds and as an
+    // HTTP date. Not for packs, like checksums.
+    bool http_metadata = false;
+
+    // Modification times later than this, in Unix seconds, are given as
+    // this instead, as reproducible builds clamp them to SOURCE_DATE_EPOCH.
+    // Otherwise bin.h differs between checkouts and changes, rebuilding
+    // everything including it, whenever a file is only touched. Negative
+    // for none.
+    int64_t source_date_epoch = -1;
+
+    // Also embeds a gzip of each compressible file, see IsCompressible(), as
+    // <name>_gz next to it, for servers to send as Content-Encoding: gzip
+    // without compressing per request. Only kept if at most this percentage
+    // of the file's size; others get an empty <name>_gz, as do dev builds.
+    // Zero turns it off. Not for packs, and not counted by plans, which read
+    // no files. The gzip is a different representation for HTTP caches:
+    // send Vary: Accept-Encoding, and with HTTP metadata the gzip's own
+    // ETag, <name>_http.gzip_etag, rather than <name>_http.etag.
+    uint32_t gzip_max_percent = 0;
+
+    // Also writes bin_profile.cpp, and counts each access to a file in a
+    // profile the program writes with WriteAccessProfile(): how often and
+    // when each file was first accessed, and how long it took to inflate.
+    // Find() counts the files it finds, and ReadAt() and the other readers
+    // the compressed files they read. Listings don't count the files they
+    // hand out, File::Bytes() does when their bytes are taken, though not
+    // their data member. Files read through their own names count too:
+    // bin.h declares each as a ProfiledResource over <name>_bytes. Needs
+    // the index. Not for packs.
+    bool instrument = false;
+
+    // Also writes the declarations in bin.h as the C++20 module of this name:
+    // a partition bin-<namespace>.cppm for each directory in the input root,
+    // and the primary interface bin.cppm, which exports them, the root's
+    // own files and the <root>::dir2src runtime. Empty to write no module.
+    std::string module_name;
+
+    // Only walks the tree, reading no files but the ignore file, and fills
+    // GenerateResult's plan with what generating would write. Every shard is
+    // planned, whatever shard_index is. Nothing is written.
+    bool plan = false;
+};
+
+// Only valid for the duration of the visit
+struct DirectoryEntry {
+    std::string_view name;
+    bool is_directory = false;
+    uint64_t size = 0;
+
+    // Of files, in seconds since the Unix epoch; 0 when unknown
+    int64_t modified_time = 0;
+};
+
+using DirectoryVisitor = std::function<void(const DirectoryEntry& entry)>;
+
+// Where input files come from: the filesystem, memory or a caller's VFS.
+// ReadFile() is called from several threads at once, and reuses the
+// capacity of the buffer it's given.
+class FileSource {
+public:
+    virtual ~FileSource() = default;
+
+    virtual bool ListDirectory(std::string_view directory_path, const DirectoryVisitor& visit) = 0;
+    virtual bool ReadFile(std::string_view file_path, std::vector<uint8_t>* output_buffer) = 0;
+};
+
+// Where generated files go
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    // Sinks may take the write over and complete it later
+    virtual bool WriteFile(std::string_view file_path, std::string contents) = 0;
+
+    // Waits for outstanding writes. Returns false if any of them failed.
+    virtual bool Flush() { return true; }
+
+    // An empty buffer to build the next output in, ideally with capacity
+    // left over from a completed write. Called from several threads at once.
+    virtual std::string AcquireBuffer() { return {}; }
+};
+
+// Files and their generated size, from their listed size
+struct PlanEntry {
+    std::string_view path;
+    size_t file_count = 0;
+    uint64_t input_bytes = 0;
+
+    // Written with Format::ARRAY and Format::HEX
+    uint64_t array_bytes = 0;
+    uint64_t hex_bytes = 0;
+
+    // Roughly the most a compiler holds while building the initializers;
+    // zero for outputs that aren't compiled
+    uint64_t compile_memory = 0;
+};
+
+struct GenerateResult {
+    // Backs the paths below
+    Arena arena;
+
+    // Directories listed and files read, e.g. for depfiles
+    std::vector<std::string_view> input_paths;
+
+    // Files written, bin.h first when written
+    std::vector<std::string_view> output_paths;
+
+    // With Options::minify, the files minified and how much smaller they got
+    size_t minified_file_count = 0;
+    uint64_t minified_bytes_saved = 0;
+
+    // With Options::gzip_max_percent, the files given a gzip and how much
+    // smaller those are
+    size_t gzipped_file_count = 0;
+    uint64_t gzipped_bytes_saved = 0;
+
+    // With Options::plan, each directory's own files in walk order, and
+    // each source or pack they would be written to. The files' sizes are
+    // taken before minification.
+    std::vector<PlanEntry> planned_directories;
+    std::vector<PlanEntry> planned_outputs;
+};
+
+// Walks the source from its root and writes bin.h and the resource
+// definitions to the sink. Each directory's files come before its
+// subdirectories, both sorted by name byte-wise, so the output only
+// depends on the tree. Returns false if any input couldn't be listed or
+// read or any output couldn't be written; generation carries on regardless.
+bool Generate(FileSource& source, OutputSink& sink, const Options& options, GenerateResult* result = nullptr);
+
+// Splits on each occurrence of the delimiter, dropping empty tokens
+std::vector<std::string> SplitString(std::string string, const std::string& delimiter);
+
+// Files held in memory, keyed by path
+class MemoryFileSource : public FileSource {
+public:
+    void AddFile(std::string file_path, std::vector<uint8_t> data);
+
+    bool ListDirectory(std::string_view directory_path, const DirectoryVisitor& visit) override;
+    bool ReadFile(std::string_view file_path, std::vector<uint8_t>* output_buffer) override;
+
+private:
+    std::map<std::string, std::vector<uint8_t>, std::less<>> files;
+};
+
+// Generated files held in memory, keyed by path
+class MemoryOutputSink : public OutputSink {
+public:
+    bool WriteFile(std::string_view file_path, std::string contents) override;
+
+    std::map<std::string, std::string, std::less<>> files;
+};
+
+class DiskFileSource : public FileSource {
+public:
+    explicit DiskFileSource(std::string root_path);
+
+    bool ListDirectory(std::string_view directory_path, const DirectoryVisitor& visit) override;
+    bool ReadFile(std::string_view file_path, std::vector<uint8_t>* output_buffer) override;
+
+    // Native path of a root-relative path
+    std::string DiskPath(std::string_view path) const;
+
+private:
+    std::string root_path;
+};
+
+class DiskOutputSink : public OutputSink {
+public:
+    // With restat, files already holding the generated contents are left
+    // untouched so build systems can skip work downstream of them.
+    //
+    // With write_threads > 0, writes are queued and their open/write/close
+    // performed in batches by that many background threads, overlapping
+    // with generation. Otherwise each write completes before returning.
+    DiskOutputSink(std::string root_path, bool restat, size_t write_threads = 0);
+    ~DiskOutputSink() override;
+
+    bool WriteFile(std::string_view file_path, std::string contents) override;
+    bool Flush() override;
+    std::string AcquireBuffer() override;
+
+    // Native path of a root-relative path
+    std::string DiskPath(std::string_view path) const;
+
+private:
+    struct PendingWrite {
+        std::string disk_path;
+        std::string contents;
+    };
+
+    bool WriteNow(const std::string& disk_path, std::string_view contents);
+    void WriterThread();
+
+    // Completed writes hand their buffers back for AcquireBuffer() to reuse.
+    // Called with queue_mutex held.
+    void RecycleBuffer(std::string buffer);
+
+    std::string root_path;
+    bool restat;
+
+    // Every output shares a few parent directories, don't recreate them
+    std::mutex directories_mutex;
+    std::unordered_set<std::string> created_directories;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_not_empty;
+    std::condition_variable queue_drained;
+
+    // Popped from queue_head; a vector so pending writes don't allocate nodes
+    std::vector<PendingWrite> queue;
+    size_t queue_head = 0;
+
+    std::vector<std::string> spare_paths;
+    std::vector<std::string> spare_buffers;
+
+    size_t queued_bytes = 0;
+    size_t writes_in_flight = 0;
+    bool write_failed = false;
+    bool stopping = false;
+
+    std::vector<std::thread> writer_threads;
+};
+
+} // namespace dir2src
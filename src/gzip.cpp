@@ -0,0 +1,627 @@
+#include "gzip.h"
+
+#include <algorithm>
+#include <array>
+
+namespace dir2src {
+
+namespace {
+
+constexpr size_t window_size = 32768;
+constexpr size_t min_match = 3;
+constexpr size_t max_match = 258;
+
+// As zlib's level 9: chains are searched this far, a quarter as far after
+// a good match, and a match this long ends the search and the lazy step
+constexpr size_t max_chain = 4096;
+constexpr size_t good_match = 32;
+constexpr size_t nice_match = 258;
+
+// Three-byte matches this far back cost more than their literals
+constexpr size_t too_far = 4096;
+
+constexpr size_t hash_bits = 15;
+
+// Tokens per block. Each block gets codes fitted to its own tokens.
+constexpr size_t block_token_count = 16384;
+
+constexpr size_t literal_length_count = 286;
+constexpr size_t distance_count = 30;
+constexpr size_t code_length_count = 19;
+constexpr uint16_t end_of_block = 256;
+
+constexpr uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+constexpr uint8_t length_extra_bits[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+constexpr uint16_t distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577,
+};
+constexpr uint8_t distance_extra_bits[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+// Code lengths are sent in this order, so trailing unused ones can be cut
+constexpr uint8_t code_length_order[code_length_count] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+// A literal when distance is zero, otherwise a match
+struct Token {
+    uint16_t literal_or_length = 0;
+    uint16_t distance = 0;
+};
+
+size_t LengthIndex(size_t length) {
+    return std::upper_bound(std::begin(length_base), std::end(length_base), length) - std::begin(length_base) - 1;
+}
+
+size_t DistanceIndex(size_t distance) {
+    return std::upper_bound(std::begin(distance_base), std::end(distance_base), distance) - std::begin(distance_base) - 1;
+}
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>* out) : out(out) {}
+
+    // Least significant bit first, as DEFLATE packs everything but codes
+    void Put(uint32_t value, size_t count) {
+        bits |= (uint64_t)value << bit_count;
+        bit_count += count;
+
+        while (bit_count >= 8) {
+            out->push_back((uint8_t)bits);
+            bits >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    void AlignToByte() {
+        if (bit_count > 0) Put(0, 8 - bit_count);
+    }
+
+private:
+    std::vector<uint8_t>* out;
+    uint64_t bits = 0;
+    size_t bit_count = 0;
+};
+
+// Huffman code lengths of at most max_bits for the frequencies, zero for
+// symbols never used. Codes too long for the limit are shortened the way
+// miniz does: the deepest leaves move up and shallower ones split to
+// keep the code complete.
+std::vector<uint8_t> CodeLengths(std::span<const uint32_t> frequencies, size_t max_bits) {
+    std::vector<uint8_t> lengths(frequencies.size());
+    std::vector<uint16_t> symbols;
+
+    for (size_t i = 0; i < frequencies.size(); ++i) {
+        if (frequencies[i] > 0) symbols.push_back((uint16_t)i);
+    }
+
+    if (symbols.empty()) return lengths;
+
+    // A lone symbol still gets a one-bit partner, as some decoders reject
+    // incomplete codes
+    if (symbols.size() == 1) {
+        lengths[symbols[0]] = 1;
+        lengths[symbols[0] == 0 ? 1 : 0] = 1;
+        return lengths;
+    }
+
+    std::stable_sort(symbols.begin(), symbols.end(), [&](uint16_t a, uint16_t b) {
+        return frequencies[a] < frequencies[b];
+    });
+
+    // Leaves, then internal nodes in the order they're made, which is also
+    // nondecreasing weight: the two lightest of both come off the fronts
+    const size_t leaf_count = symbols.size();
+    std::vector<uint64_t> weights(2 * leaf_count - 1);
+    std::vector<size_t> parents(2 * leaf_count - 1);
+
+    for (size_t i = 0; i < leaf_count; ++i) {
+        weights[i] = frequencies[symbols[i]];
+    }
+
+    size_t next_leaf = 0;
+    size_t next_internal = leaf_count;
+
+    for (size_t node = leaf_count; node < weights.size(); ++node) {
+        size_t children[2];
+
+        for (size_t& child : children) {
+            if (next_leaf < leaf_count && (next_internal >= node || weights[next_leaf] <= weights[next_internal])) {
+                child = next_leaf++;
+            }
+            else {
+                child = next_internal++;
+            }
+        }
+
+        weights[node] = weights[children[0]] + weights[children[1]];
+        parents[children[0]] = node;
+        parents[children[1]] = node;
+    }
+
+    // Parents come after their children, so depths fill in from the root
+    std::vector<size_t> depths(weights.size());
+    std::vector<size_t> length_counts(leaf_count + 1);
+
+    for (size_t node = weights.size() - 1; node-- > 0;) {
+        depths[node] = depths[parents[node]] + 1;
+        if (node < leaf_count) ++length_counts[depths[node]];
+    }
+
+    if (length_counts.size() > max_bits + 1) {
+        for (size_t length = max_bits + 1; length < length_counts.size(); ++length) {
+            length_counts[max_bits] += length_counts[length];
+        }
+        length_counts.resize(max_bits + 1);
+
+        uint64_t kraft_total = 0;
+        for (size_t length = 1; length <= max_bits; ++length) {
+            kraft_total += (uint64_t)length_counts[length] << (max_bits - length);
+        }
+
+        for (; kraft_total > (1ull << max_bits); --kraft_total) {
+            --length_counts[max_bits];
+
+            for (size_t length = max_bits - 1; length > 0; --length) {
+                if (length_counts[length] > 0) {
+                    --length_counts[length];
+                    length_counts[length + 1] += 2;
+                    break;
+                }
+            }
+        }
+    }
+
+    // The lightest symbols take the longest codes
+    size_t symbol_idx = 0;
+
+    for (size_t length = length_counts.size() - 1; length > 0; --length) {
+        for (size_t i = 0; i < length_counts[length]; ++i) {
+            lengths[symbols[symbol_idx++]] = (uint8_t)length;
+        }
+    }
+
+    return lengths;
+}
+
+// Canonical codes for the lengths, bit-reversed to be written least
+// significant bit first
+std::vector<uint16_t> CanonicalCodes(std::span<const uint8_t> lengths) {
+    uint16_t length_counts[16] = {};
+    for (uint8_t length : lengths) ++length_counts[length];
+    length_counts[0] = 0;
+
+    uint16_t next_codes[16] = {};
+    for (size_t length = 1, code = 0; length < 16; ++length) {
+        code = (code + length_counts[length - 1]) << 1;
+        next_codes[length] = (uint16_t)code;
+    }
+
+    std::vector<uint16_t> codes(lengths.size());
+
+    for (size_t symbol = 0; symbol < lengths.size(); ++symbol) {
+        const uint8_t length = lengths[symbol];
+        if (length == 0) continue;
+
+        uint16_t code = next_codes[length]++;
+        uint16_t reversed = 0;
+
+        for (size_t i = 0; i < length; ++i) {
+            reversed = (uint16_t)((reversed << 1) | (code & 1));
+            code >>= 1;
+        }
+
+        codes[symbol] = reversed;
+    }
+
+    return codes;
+}
+
+struct Codes {
+    std::vector<uint8_t> literal_length_lengths;
+    std::vector<uint8_t> distance_lengths;
+};
+
+Codes FixedCodes() {
+    Codes codes;
+    codes.literal_length_lengths.resize(288);
+    codes.distance_lengths.assign(30, 5);
+
+    std::fill(codes.literal_length_lengths.begin(), codes.literal_length_lengths.begin() + 144, 8);
+    std::fill(codes.literal_length_lengths.begin() + 144, codes.literal_length_lengths.begin() + 256, 9);
+    std::fill(codes.literal_length_lengths.begin() + 256, codes.literal_length_lengths.begin() + 280, 7);
+    std::fill(codes.literal_length_lengths.begin() + 280, codes.literal_length_lengths.end(), 8);
+
+    return codes;
+}
+
+uint64_t TokenBits(std::span<const Token> tokens, const Codes& codes) {
+    uint64_t bits = codes.literal_length_lengths[end_of_block];
+
+    for (const Token& token : tokens) {
+        if (token.distance == 0) {
+            bits += codes.literal_length_lengths[token.literal_or_length];
+            continue;
+        }
+
+        const size_t length_idx = LengthIndex(token.literal_or_length);
+        const size_t distance_idx = DistanceIndex(token.distance);
+
+        bits += codes.literal_length_lengths[257 + length_idx] + length_extra_bits[length_idx];
+        bits += codes.distance_lengths[distance_idx] + distance_extra_bits[distance_idx];
+    }
+
+    return bits;
+}
+
+void WriteTokens(BitWriter& writer, std::span<const Token> tokens, const Codes& codes) {
+    const std::vector<uint16_t> literal_length_codes = CanonicalCodes(codes.literal_length_lengths);
+    const std::vector<uint16_t> distance_codes = CanonicalCodes(codes.distance_lengths);
+
+    for (const Token& token : tokens) {
+        if (token.distance == 0) {
+            writer.Put(literal_length_codes[token.literal_or_length], codes.literal_length_lengths[token.literal_or_length]);
+            continue;
+        }
+
+        const size_t length_idx = LengthIndex(token.literal_or_length);
+        const size_t distance_idx = DistanceIndex(token.distance);
+
+        writer.Put(literal_length_codes[257 + length_idx], codes.literal_length_lengths[257 + length_idx]);
+        writer.Put(token.literal_or_length - length_base[length_idx], length_extra_bits[length_idx]);
+
+        writer.Put(distance_codes[distance_idx], codes.distance_lengths[distance_idx]);
+        writer.Put(token.distance - distance_base[distance_idx], distance_extra_bits[distance_idx]);
+    }
+
+    writer.Put(literal_length_codes[end_of_block], codes.literal_length_lengths[end_of_block]);
+}
+
+// Both trees' code lengths, run-length encoded with symbols 16 to 18
+struct CodeLengthRun {
+    uint8_t symbol = 0;
+    uint8_t extra = 0;
+};
+
+std::vector<CodeLengthRun> RunLengthEncode(std::span<const uint8_t> lengths) {
+    std::vector<CodeLengthRun> runs;
+
+    for (size_t i = 0; i < lengths.size();) {
+        const uint8_t length = lengths[i];
+
+        size_t run = 1;
+        while (i + run < lengths.size() && lengths[i + run] == length) ++run;
+
+        size_t remaining = run;
+
+        if (length == 0) {
+            for (; remaining >= 11; remaining -= std::min<size_t>(remaining, 138)) {
+                runs.push_back({ 18, (uint8_t)(std::min<size_t>(remaining, 138) - 11) });
+            }
+
+            if (remaining >= 3) {
+                runs.push_back({ 17, (uint8_t)(remaining - 3) });
+                remaining = 0;
+            }
+        }
+        else if (remaining >= 4) {
+            // The first is sent as is, then repeated
+            runs.push_back({ length, 0 });
+            --remaining;
+
+            for (; remaining >= 3; remaining -= std::min<size_t>(remaining, 6)) {
+                runs.push_back({ 16, (uint8_t)(std::min<size_t>(remaining, 6) - 3) });
+            }
+        }
+
+        for (; remaining > 0; --remaining) {
+            runs.push_back({ length, 0 });
+        }
+
+        i += run;
+    }
+
+    return runs;
+}
+
+constexpr uint8_t CodeLengthExtraBits(uint8_t symbol) {
+    return symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0;
+}
+
+void WriteBlock(BitWriter& writer, std::span<const Token> tokens, std::span<const uint8_t> raw, bool final_block) {
+    std::array<uint32_t, literal_length_count> literal_length_frequencies = {};
+    std::array<uint32_t, distance_count> distance_frequencies = {};
+
+    for (const Token& token : tokens) {
+        if (token.distance == 0) {
+            ++literal_length_frequencies[token.literal_or_length];
+        }
+        else {
+            ++literal_length_frequencies[257 + LengthIndex(token.literal_or_length)];
+            ++distance_frequencies[DistanceIndex(token.distance)];
+        }
+    }
+
+    ++literal_length_frequencies[end_of_block];
+
+    Codes dynamic_codes;
+    dynamic_codes.literal_length_lengths = CodeLengths(literal_length_frequencies, 15);
+    dynamic_codes.distance_lengths = CodeLengths(distance_frequencies, 15);
+
+    // At least one distance code is always sent
+    if (std::all_of(dynamic_codes.distance_lengths.begin(), dynamic_codes.distance_lengths.end(), [](uint8_t l) { return l == 0; })) {
+        dynamic_codes.distance_lengths[0] = 1;
+        dynamic_codes.distance_lengths[1] = 1;
+    }
+
+    size_t literal_length_sent = literal_length_count;
+    while (literal_length_sent > 257 && dynamic_codes.literal_length_lengths[literal_length_sent - 1] == 0) --literal_length_sent;
+
+    size_t distance_sent = distance_count;
+    while (distance_sent > 1 && dynamic_codes.distance_lengths[distance_sent - 1] == 0) --distance_sent;
+
+    std::vector<uint8_t> sent_lengths(dynamic_codes.literal_length_lengths.begin(), dynamic_codes.literal_length_lengths.begin() + literal_length_sent);
+    sent_lengths.insert(sent_lengths.end(), dynamic_codes.distance_lengths.begin(), dynamic_codes.distance_lengths.begin() + distance_sent);
+
+    const std::vector<CodeLengthRun> runs = RunLengthEncode(sent_lengths);
+
+    std::array<uint32_t, code_length_count> code_length_frequencies = {};
+    for (const CodeLengthRun& run : runs) ++code_length_frequencies[run.symbol];
+
+    const std::vector<uint8_t> code_length_lengths = CodeLengths(code_length_frequencies, 7);
+
+    size_t code_length_sent = code_length_count;
+    while (code_length_sent > 4 && code_length_lengths[code_length_order[code_length_sent - 1]] == 0) --code_length_sent;
+
+    uint64_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * code_length_sent + TokenBits(tokens, dynamic_codes);
+    for (const CodeLengthRun& run : runs) {
+        dynamic_bits += code_length_lengths[run.symbol] + CodeLengthExtraBits(run.symbol);
+    }
+
+    static const Codes fixed_codes = FixedCodes();
+    const uint64_t fixed_bits = 3 + TokenBits(tokens, fixed_codes);
+
+    // Each stored block's header is padded to a byte, then takes four more
+    const uint64_t stored_block_count = std::max<size_t>((raw.size() + 65534) / 65535, 1);
+    const uint64_t stored_bits = stored_block_count * (3 + 7 + 32) + raw.size() * 8;
+
+    if (stored_bits < dynamic_bits && stored_bits < fixed_bits) {
+        for (size_t offset = 0; offset < raw.size() || offset == 0; offset += 65535) {
+            const size_t size = std::min<size_t>(raw.size() - offset, 65535);
+            const bool last = offset + size >= raw.size();
+
+            writer.Put(final_block && last ? 1 : 0, 1);
+            writer.Put(0, 2);
+            writer.AlignToByte();
+            writer.Put((uint32_t)size, 16);
+            writer.Put((uint32_t)(~size & 0xFFFF), 16);
+
+            for (size_t i = 0; i < size; ++i) {
+                writer.Put(raw[offset + i], 8);
+            }
+
+            if (raw.empty()) break;
+        }
+        return;
+    }
+
+    writer.Put(final_block ? 1 : 0, 1);
+
+    if (fixed_bits <= dynamic_bits) {
+        writer.Put(1, 2);
+        WriteTokens(writer, tokens, fixed_codes);
+        return;
+    }
+
+    writer.Put(2, 2);
+    writer.Put((uint32_t)(literal_length_sent - 257), 5);
+    writer.Put((uint32_t)(distance_sent - 1), 5);
+    writer.Put((uint32_t)(code_length_sent - 4), 4);
+
+    for (size_t i = 0; i < code_length_sent; ++i) {
+        writer.Put(code_length_lengths[code_length_order[i]], 3);
+    }
+
+    const std::vector<uint16_t> code_length_codes = CanonicalCodes(code_length_lengths);
+
+    for (const CodeLengthRun& run : runs) {
+        writer.Put(code_length_codes[run.symbol], code_length_lengths[run.symbol]);
+        writer.Put(run.extra, CodeLengthExtraBits(run.symbol));
+    }
+
+    WriteTokens(writer, tokens, dynamic_codes);
+}
+
+// Positions are stored plus one in the hash chains, so zero ends a chain
+class MatchFinder {
+public:
+    explicit MatchFinder(std::span<const uint8_t> data)
+        : data(data), head(size_t(1) << hash_bits), previous(window_size) {}
+
+    // Adds the position to its chain and returns the chain's previous head
+    uint32_t Insert(size_t pos) {
+        if (pos + min_match > data.size()) return 0;
+
+        const size_t hash = ((data[pos] << 10) ^ (data[pos + 1] << 5) ^ data[pos + 2]) & (head.size() - 1);
+        const uint32_t candidate = head[hash];
+
+        previous[pos & (window_size - 1)] = candidate;
+        head[hash] = (uint32_t)pos + 1;
+
+        return candidate;
+    }
+
+    // The longest match at pos longer than at_least, searching from the
+    // chain head before pos was inserted. Returns zero length without one.
+    void Find(size_t pos, uint32_t candidate, size_t at_least, size_t* length, size_t* distance) const {
+        *length = 0;
+        *distance = 0;
+
+        const size_t max_length = std::min(max_match, data.size() - pos);
+        if (max_length < min_match) return;
+
+        size_t best_length = std::max(at_least, min_match - 1);
+        size_t chain = at_least >= good_match ? max_chain / 4 : max_chain;
+
+        for (; candidate != 0 && chain > 0; --chain) {
+            const size_t match_pos = candidate - 1;
+
+            // Older entries may have been overwritten by newer positions
+            if (match_pos >= pos || pos - match_pos >= window_size) break;
+
+            const uint8_t* a = data.data() + match_pos;
+            const uint8_t* b = data.data() + pos;
+
+            if (a[best_length] == b[best_length] && a[0] == b[0] && a[1] == b[1]) {
+                size_t match_length = 2;
+                while (match_length < max_length && a[match_length] == b[match_length]) ++match_length;
+
+                if (match_length > best_length) {
+                    best_length = match_length;
+                    *length = match_length;
+                    *distance = pos - match_pos;
+
+                    if (match_length >= nice_match || match_length == max_length) break;
+                }
+            }
+
+            candidate = previous[match_pos & (window_size - 1)];
+        }
+    }
+
+private:
+    std::span<const uint8_t> data;
+    std::vector<uint32_t> head;
+    std::vector<uint32_t> previous;
+};
+
+uint32_t Crc32(std::span<const uint8_t> data) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t = {};
+
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t crc = n;
+            for (int k = 0; k < 8; ++k) {
+                crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+            }
+            t[n] = crc;
+        }
+
+        return t;
+    }();
+
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (uint8_t c : data) {
+        crc = (crc >> 8) ^ table[(crc ^ c) & 0xFF];
+    }
+
+    return ~crc;
+}
+
+void AppendLittleEndian32(std::vector<uint8_t>* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out->push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+} // namespace
+
+void Deflate(std::span<const uint8_t> data, std::vector<uint8_t>* out) {
+    BitWriter writer(out);
+    MatchFinder match_finder(data);
+
+    std::vector<Token> tokens;
+    tokens.reserve(block_token_count);
+
+    size_t block_start = 0;
+
+    auto add_token = [&](Token token, size_t next_pos) {
+        tokens.push_back(token);
+
+        if (tokens.size() == block_token_count) {
+            WriteBlock(writer, tokens, data.subspan(block_start, next_pos - block_start), false);
+            tokens.clear();
+            block_start = next_pos;
+        }
+    };
+
+    // zlib's lazy matching: a match is only taken if the next position
+    // doesn't start a longer one, otherwise its first byte goes as a literal
+    size_t previous_length = 0;
+    size_t previous_distance = 0;
+    bool previous_pending = false;
+
+    for (size_t pos = 0; pos < data.size();) {
+        const uint32_t candidate = match_finder.Insert(pos);
+
+        size_t length = 0;
+        size_t distance = 0;
+
+        if (!previous_pending || previous_length < nice_match) {
+            match_finder.Find(pos, candidate, previous_pending ? previous_length : 0, &length, &distance);
+
+            if (length == min_match && distance > too_far) length = 0;
+        }
+
+        if (previous_pending && previous_length >= min_match && length <= previous_length) {
+            const size_t match_end = pos - 1 + previous_length;
+
+            for (size_t skipped = pos + 1; skipped < match_end; ++skipped) {
+                match_finder.Insert(skipped);
+            }
+
+            add_token({ (uint16_t)previous_length, (uint16_t)previous_distance }, match_end);
+
+            pos = match_end;
+            previous_pending = false;
+            continue;
+        }
+
+        if (previous_pending) {
+            add_token({ data[pos - 1], 0 }, pos);
+        }
+
+        previous_length = length;
+        previous_distance = distance;
+        previous_pending = true;
+        ++pos;
+    }
+
+    if (previous_pending) {
+        add_token({ data[data.size() - 1], 0 }, data.size());
+    }
+
+    WriteBlock(writer, tokens, data.subspan(block_start), true);
+    writer.AlignToByte();
+}
+
+void Gzip(std::span<const uint8_t> data, std::vector<uint8_t>* out) {
+    // No flags, name or timestamp; XFL 2 for the slowest compression, OS
+    // unknown
+    constexpr uint8_t header[] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 2, 255 };
+
+    out->insert(out->end(), std::begin(header), std::end(header));
+    Deflate(data, out);
+
+    AppendLittleEndian32(out, Crc32(data));
+    AppendLittleEndian32(out, (uint32_t)data.size());
+}
+
+void DeflateChunks(std::span<const uint8_t> data, size_t chunk_size, std::vector<uint8_t>* out, std::vector<uint64_t>* chunk_offsets) {
+    // Deflate() appends, so each chunk starts where the last ended
+    for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+        chunk_offsets->push_back(out->size());
+        Deflate(data.subspan(offset, std::min(chunk_size, data.size() - offset)), out);
+    }
+
+    chunk_offsets->push_back(out->size());
+}
+
+} // namespace dir2src
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace dir2src {
+
+// Raw DEFLATE (RFC 1951), appended to the output. Compresses about as far
+// as zlib's best level: lazy LZ77 matching over the whole 32 KiB window
+// with long hash chains, then for each block whichever of dynamic Huffman,
+// fixed Huffman or stored codes is smallest. Meant for build time, where
+// size matters more than speed.
+void Deflate(std::span<const uint8_t> data, std::vector<uint8_t>* out);
+
+// The same wrapped as gzip (RFC 1952), for Content-Encoding: gzip. The
+// header carries no name or timestamp, so equal data gzips equally.
+void Gzip(std::span<const uint8_t> data, std::vector<uint8_t>* out);
+
+// Each chunk_size bytes of the data deflated on their own, the last chunk
+// shorter, so each can be inflated without the others. The chunks are
+// appended to out and chunk_offsets gets where each starts in out, then
+// where the last ends. Runs on the calling thread: the generator already
+// deflates one file per encoder thread.
+void DeflateChunks(std::span<const uint8_t> data, size_t chunk_size, std::vector<uint8_t>* out, std::vector<uint64_t>* chunk_offsets);
+
+} // namespace dir2src
@@ -1,5 +1,9 @@
+#include "dir2src.h"
+
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstring>
 #include <deque>
 #include <iomanip>
 #include <unordered_map>
@@ -9,121 +13,33 @@
 #define NOMINMAX
 #include <Windows.h>
 
-bool ReadFile(std::string_view file_path, std::vector<uint8_t>* output_buffer) {
-    HANDLE h_input_file = ::CreateFile(
-        file_path.data(),      // lpFileName
-        GENERIC_READ,          // dwDesiredAccess
-        0,                     // dwShareMode
-        NULL,                  // lpSecurityAttributes
-        OPEN_EXISTING,         // dwCreeationDisposition
-        FILE_ATTRIBUTE_NORMAL, // dwFlagsAndAttributes
-        NULL                   // hTemplateFile
-    );
-
-    if (h_input_file == INVALID_HANDLE_VALUE) {
-        fprintf(stderr, "Failed to open input file: %lu", GetLastError());
-        return false;
-    }
-
-    DWORD file_size = ::GetFileSize(h_input_file, nullptr);
-
-    output_buffer->resize(static_cast<size_t>(file_size));
-
-    DWORD number_of_bytes_read;
-    BOOL read_success = ::ReadFile(h_input_file, output_buffer->data(), file_size, &number_of_bytes_read, NULL);
-
-    if (!read_success) {
-        fprintf(stderr, "Failed to read input file: %lu", GetLastError());
-        CloseHandle(h_input_file);
-        return false;
-    }
-
-    return true;
-}
-
-std::string CodeFriendlyString(std::string str) {
-    for (auto& c : str) {
-        if (!std::isalnum(c)) {
-            c = '_';
-        }
-    }
-
-    while (!std::isalnum(str.front())) {
-        str.erase(0, 1);
-    }
-
-    if (std::isdigit(str.front())) {
-        str = "_" + str;
-    }
+std::string FullPath(const std::string& file_path) {
+    DWORD full_path_length = ::GetFullPathName(file_path.c_str(), 0, NULL, NULL);
+    std::string full_path(full_path_length, '\0');
+    full_path.resize(::GetFullPathName(file_path.c_str(), full_path_length, full_path.data(), NULL));
 
-    return str;
+    return full_path;
 }
 
-std::vector<std::string> SplitString(std::string string, const std::string& delimiter) {
-    std::vector<std::string> ret;
-
-    size_t delimiter_idx = 0;
-    while (delimiter_idx != std::string::npos) {
-        delimiter_idx = string.find(delimiter);
-        std::string token = string.substr(0, delimiter_idx);
+// Absolute, forward-slashed and escaped for make-format depfiles
+std::string DepfilePath(const std::string& file_path) {
+    std::string full_path = FullPath(file_path);
 
-        if (!token.empty()) {
-            ret.push_back(token);
-        }
-        string.erase(0, delimiter_idx + 1);
+    while (!full_path.empty() && (full_path.back() == '\\' || full_path.back() == '/')) {
+        full_path.pop_back();
     }
 
-    return ret;
-}
-
-std::string NormalizeDirectoryString(std::string string) {
-    if (string.empty()) return string;
+    std::string escaped;
+    for (char c : full_path) {
+        if (c == '\\') c = '/';
 
-    for (auto& c : string) {
-        if (c == '/') c = '\\';
-    }
+        if (c == ' ' || c == '#') escaped.push_back('\\');
+        else if (c == '$') escaped.push_back('$');
 
-    if (string.back() != '\\') {
-        string.push_back('\\');
+        escaped.push_back(c);
     }
 
-    return string;
-}
-
-bool WriteFile(std::string_view file_path, std::string_view contents) {
-    HANDLE h_output_file = ::CreateFile(
-        file_path.data(),      // lpFileName
-        GENERIC_WRITE,         // dwDesiredAccess
-        0,                     // dwShareMode
-        NULL,                  // lpSecurityAttributes
-        CREATE_ALWAYS,         // dwCreeationDisposition
-        FILE_ATTRIBUTE_NORMAL, // dwFlagsAndAttributes
-        NULL                   // hTemplateFile
-    );
-
-    if (h_output_file == INVALID_HANDLE_VALUE) {
-        fprintf(stderr, "Failed to create output file: %lu", GetLastError());
-        CloseHandle(h_output_file);
-        return false;
-    }
-
-    DWORD number_of_bytes_written;
-
-    BOOL write_success = ::WriteFile(
-        h_output_file,
-        contents.data(),
-        (DWORD)contents.size(),
-        &number_of_bytes_written,
-        NULL
-    );
-
-    if (!write_success) {
-        fprintf(stderr, "Failed to write output file: %lu", GetLastError());
-        CloseHandle(h_output_file);
-        return false;
-    }
-
-    return true;
+    return escaped;
 }
 
 struct CommandLineOption {
@@ -132,17 +48,52 @@ struct CommandLineOption {
         HELP,
         ROOT_NAMESPACE,
         PRINT_OUTPUT_FILES,
+        FORMAT,
+        DEPFILE,
+        RESTAT,
+        STAMP,
+        SHARD,
+        WRITE_THREADS,
+        READ_THREADS,
+        ENCODE_THREADS,
+        INCLUDE,
+        EXCLUDE,
+        IGNORE_FILE,
+        NUL_TERMINATE,
+        SMALL_FILE_SIZE,
+        SMALL_BATCH_SIZE,
+        BULK_FILE_SIZE,
+        BULK_FALLBACK,
+        INDEX,
+        PACK,
+        PACK_PATH,
+        DEV,
+        HEADER_ONLY,
+        MINIFY,
+        MODULE,
+        LAYOUT_PROFILE,
+        PRUNE_UNPROFILED,
+        PAGE_ALIGN,
+        CHECKSUM,
+        HTTP_METADATA,
+        SOURCE_DATE_EPOCH,
+        GZIP,
+        COMPRESS,
+        CHUNK_SIZE,
+        INSTRUMENT,
+        PLAN,
         MAX
     } id;
 
     std::string long_name;
     std::string short_name;
     std::string description;
-    std::string default;
+    std::string default_value;
 
     enum class Type {
         BOOLEAN,
         STRING,
+        LIST, // may be repeated, values are joined with ';'
     } type;
 };
 
@@ -153,7 +104,7 @@ CommandLineOption command_line_options[] = {
         .long_name = "help",
         .short_name = "h",
         .description = "print this summary",
-        .default = "0",
+        .default_value = "0",
         .type = CommandLineOption::Type::BOOLEAN,
     },
     CommandLineOption {
@@ -161,7 +112,7 @@ CommandLineOption command_line_options[] = {
         .long_name = "root-namespace",
         .short_name = "n",
         .description = "name of root namespace in output",
-        .default = "Bin",
+        .default_value = "Bin",
         .type = CommandLineOption::Type::STRING,
     },
     CommandLineOption {
@@ -169,11 +120,371 @@ CommandLineOption command_line_options[] = {
         .long_name = "print-output-files",
         .short_name = "p",
         .description = "print absolute paths of output source files\ne.g. to feed into build systems",
-        .default = "0",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::FORMAT,
+        .long_name = "format",
+        .short_name = "f",
+        .description = "format of array initializers in output\none of: array (decimal), hex",
+        .default_value = "array",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::DEPFILE,
+        .long_name = "depfile",
+        .short_name = "d",
+        .description = "write a make-format depfile listing every output as\ndepending on every input file and directory walked",
+        .default_value = "",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::RESTAT,
+        .long_name = "restat",
+        .short_name = "r",
+        .description = "only rewrite outputs whose contents changed\ne.g. for ninja rules with restat = 1",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::STAMP,
+        .long_name = "stamp",
+        .short_name = "",
+        .description = "file touched on every run and named first in the depfile\ne.g. as the OUTPUT of a rule whose sources are BYPRODUCTS",
+        .default_value = "",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::SHARD,
+        .long_name = "shard",
+        .short_name = "s",
+        .description = "<index>/<count>: only generate files hashing to this shard,\ncombined into bin_<index>.cpp; shard 0 writes bin.h",
+        .default_value = "",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::WRITE_THREADS,
+        .long_name = "write-threads",
+        .short_name = "w",
+        .description = "threads writing output files in the background\n0 writes each file before generating the next",
+        .default_value = "4",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::READ_THREADS,
+        .long_name = "read-threads",
+        .short_name = "",
+        .description = "threads prefetching input files",
+        .default_value = "4",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::ENCODE_THREADS,
+        .long_name = "encode-threads",
+        .short_name = "j",
+        .description = "threads encoding input files to source\n0 uses one per hardware thread",
+        .default_value = "0",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::INCLUDE,
+        .long_name = "include",
+        .short_name = "i",
+        .description = "only embed files matching these globs, or under directories\nmatching them; ';'-separated, may be repeated",
+        .default_value = "",
+        .type = CommandLineOption::Type::LIST,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::EXCLUDE,
+        .long_name = "exclude",
+        .short_name = "x",
+        .description = "skip files and directories matching these globs, as for\n.gitignore with '!' bringing files back; ';'-separated, may be repeated",
+        .default_value = "",
+        .type = CommandLineOption::Type::LIST,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::IGNORE_FILE,
+        .long_name = "ignore-file",
+        .short_name = "",
+        .description = "file in the input root listing more exclude globs,\none per line; empty to not look for one",
+        .default_value = ".dir2srcignore",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::NUL_TERMINATE,
+        .long_name = "nul-terminate",
+        .short_name = "z",
+        .description = "follow files matching these globs, or under directories\nmatching them, with a NUL for c_str() and view(); ';'-separated",
+        .default_value = "",
+        .type = CommandLineOption::Type::LIST,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::SMALL_FILE_SIZE,
+        .long_name = "small-file-size",
+        .short_name = "",
+        .description = "combine files of at most this many bytes into\n<dir>/bin_small_<n>.cpp; 0 gives every file its own",
+        .default_value = "0",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::SMALL_BATCH_SIZE,
+        .long_name = "small-batch-size",
+        .short_name = "",
+        .description = "input bytes per combined small file source",
+        .default_value = "1M",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::BULK_FILE_SIZE,
+        .long_name = "bulk-file-size",
+        .short_name = "",
+        .description = "embed files of at least this many bytes with the assembler\nwhere possible, from a raw copy; 0 to compile every file",
+        .default_value = "0",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::BULK_FALLBACK,
+        .long_name = "bulk-fallback",
+        .short_name = "",
+        .description = "also write each bulk file's initializer to <path>.inc, for\ncompilers without GNU inline assembly",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::INDEX,
+        .long_name = "index",
+        .short_name = "",
+        .description = "also write bin_index.cpp, a sorted index of every file\nfor runtime lookups and directory listings (C++17)",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::PACK,
+        .long_name = "pack",
+        .short_name = "",
+        .description = "write files to bin.pack, mapped at runtime by bin_pack.cpp,\ninstead of embedding them; rewriting the pack needs no relink",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::PACK_PATH,
+        .long_name = "pack-path",
+        .short_name = "",
+        .description = "where bin_pack.cpp looks for the pack unless SetPackPath() is\ncalled, relative to the working directory",
+        .default_value = "bin.pack",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::DEV,
+        .long_name = "dev",
+        .short_name = "",
+        .description = "also write bin_dev.cpp; builds defining DIR2SRC_DEV map files\nfrom the input directory on first use instead of embedding them",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::HEADER_ONLY,
+        .long_name = "header-only",
+        .short_name = "",
+        .description = "only write bin.h and its runtimes, without reading any files\nunless checksummed",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::MINIFY,
+        .long_name = "minify",
+        .short_name = "m",
+        .description = "strip comments and whitespace from JSON, GLSL/HLSL, CSS,\nSVG and HTML files before embedding them",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::MODULE,
+        .long_name = "module",
+        .short_name = "",
+        .description = "also export bin.h's declarations from the C++20 module of this\nname, one partition per top-level directory",
+        .default_value = "",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::LAYOUT_PROFILE,
+        .long_name = "layout-profile",
+        .short_name = "",
+        .description = "file listing input paths in first-read order, one per line;\nthose files are laid out first and together in that order",
+        .default_value = "",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::PRUNE_UNPROFILED,
+        .long_name = "prune-unprofiled",
+        .short_name = "",
+        .description = "leave out the files the layout profile doesn't list; from\n--instrument, those never found, read by name or read through\nFile::Bytes()",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::PAGE_ALIGN,
+        .long_name = "page-align",
+        .short_name = "",
+        .description = "page-align files of at least this many bytes and generate\nRelease() to give their pages back to the kernel; 0 to align none",
+        .default_value = "0",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::CHECKSUM,
+        .long_name = "checksum",
+        .short_name = "",
+        .description = "declare each file's CRC-32C in bin.h and generate Verify()\nto check a resource against it; not for packs",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::HTTP_METADATA,
+        .long_name = "http-metadata",
+        .short_name = "",
+        .description = "declare each file's ETag, Content-Type and Last-Modified in\nbin.h for HTTP servers; not for packs",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::SOURCE_DATE_EPOCH,
+        .long_name = "source-date-epoch",
+        .short_name = "",
+        .description = "Unix time to clamp --http-metadata's Last-Modified to, keeping\nbin.h stable; defaults to the SOURCE_DATE_EPOCH variable",
+        .default_value = "",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::GZIP,
+        .long_name = "gzip",
+        .short_name = "",
+        .description = "also embed a gzip of each compressible file as <name>_gz when\nit's at most this percentage of the size; 0 for none, not for packs",
+        .default_value = "0",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::COMPRESS,
+        .long_name = "compress",
+        .short_name = "",
+        .description = "compress files matching these globs, or under directories matching\nthem, in chunks for ReadAt(); ';'-separated, not for packs",
+        .default_value = "",
+        .type = CommandLineOption::Type::LIST,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::CHUNK_SIZE,
+        .long_name = "chunk-size",
+        .short_name = "",
+        .description = "bytes per independently compressed chunk; smaller chunks make\nsmall reads cheaper and compress worse",
+        .default_value = "64K",
+        .type = CommandLineOption::Type::STRING,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::INSTRUMENT,
+        .long_name = "instrument",
+        .short_name = "",
+        .description = "count the files found, read by name or read through File::Bytes(),\nand their inflating time, for WriteAccessProfile(); needs --index,\nnot for packs",
+        .default_value = "0",
+        .type = CommandLineOption::Type::BOOLEAN,
+    },
+    CommandLineOption {
+        .id = CommandLineOption::Id::PLAN,
+        .long_name = "plan",
+        .short_name = "",
+        .description = "only list the input and print what would be generated: sizes\nper directory and format, and the largest translation units",
+        .default_value = "0",
         .type = CommandLineOption::Type::BOOLEAN,
     },
 };
 
+// Bytes, optionally suffixed with K, M or G
+bool ParseByteSize(const std::string& str, uint64_t* size) {
+    unsigned long long number = 0;
+    char suffix = '\0';
+
+    int fields = sscanf(str.c_str(), "%llu%c", &number, &suffix);
+    if (fields < 1) return false;
+
+    switch (fields == 2 ? suffix : '\0') {
+    case '\0': *size = number; return true;
+    case 'K': *size = number << 10; return true;
+    case 'M': *size = number << 20; return true;
+    case 'G': *size = number << 30; return true;
+    default: return false;
+    }
+}
+
+// To a tenth, with the suffixes ParseByteSize() takes
+std::string FormatByteSize(uint64_t size) {
+    constexpr const char* suffixes[] = { "", "K", "M", "G" };
+
+    double scaled = (double)size;
+    size_t suffix_idx = 0;
+
+    while (scaled >= 1024 && suffix_idx + 1 < std::size(suffixes)) {
+        scaled /= 1024;
+        ++suffix_idx;
+    }
+
+    char formatted[32];
+    snprintf(formatted, sizeof(formatted), suffix_idx == 0 ? "%.0f%s" : "%.1f%s", scaled, suffixes[suffix_idx]);
+
+    return formatted;
+}
+
+void PrintPlan(const dir2src::GenerateResult& result) {
+    constexpr size_t largest_output_count = 10;
+
+    printf("%-40s %8s %10s %10s %10s\n", "Directory", "Files", "Input", "Array", "Hex");
+
+    dir2src::PlanEntry total;
+
+    for (const auto& entry : result.planned_directories) {
+        printf("%-40s %8zu %10s %10s %10s\n",
+            entry.path.empty() ? "." : std::string(entry.path).c_str(), entry.file_count,
+            FormatByteSize(entry.input_bytes).c_str(), FormatByteSize(entry.array_bytes).c_str(), FormatByteSize(entry.hex_bytes).c_str());
+
+        total.file_count += entry.file_count;
+        total.input_bytes += entry.input_bytes;
+    }
+
+    // Outputs also count what they wrap their definitions in
+    size_t compiled_count = 0;
+
+    for (const auto& entry : result.planned_outputs) {
+        total.array_bytes += entry.array_bytes;
+        total.hex_bytes += entry.hex_bytes;
+        compiled_count += entry.compile_memory > 0;
+    }
+
+    printf("%-40s %8zu %10s %10s %10s\n\n", "Total", total.file_count,
+        FormatByteSize(total.input_bytes).c_str(), FormatByteSize(total.array_bytes).c_str(), FormatByteSize(total.hex_bytes).c_str());
+
+    std::vector<const dir2src::PlanEntry*> compiled;
+
+    for (const auto& entry : result.planned_outputs) {
+        if (entry.compile_memory > 0) compiled.push_back(&entry);
+    }
+
+    std::stable_sort(compiled.begin(), compiled.end(), [](const dir2src::PlanEntry* a, const dir2src::PlanEntry* b) {
+        return a->compile_memory > b->compile_memory;
+    });
+
+    printf("%zu translation units, %zu other outputs\n", compiled_count, result.planned_outputs.size() - compiled_count);
+
+    if (compiled.empty()) return;
+
+    printf("\n%-40s %8s %10s %10s %10s %10s\n", "Largest translation units", "Files", "Input", "Array", "Hex", "Memory");
+
+    for (size_t i = 0; i < std::min(compiled.size(), largest_output_count); ++i) {
+        const auto& entry = *compiled[i];
+
+        printf("%-40s %8zu %10s %10s %10s %10s\n", std::string(entry.path).c_str(), entry.file_count,
+            FormatByteSize(entry.input_bytes).c_str(), FormatByteSize(entry.array_bytes).c_str(), FormatByteSize(entry.hex_bytes).c_str(),
+            ("~" + FormatByteSize(entry.compile_memory)).c_str());
+    }
+}
+
 void PrintHelp() {
     printf(R"(
 Usage:
@@ -214,7 +525,7 @@ Options:
         std::string spacing_str(flag_str_length - ss.str().size(), ' ');
         ss << spacing_str;
 
-        std::vector<std::string> descriptions = SplitString(flag.description, "\n");
+        std::vector<std::string> descriptions = dir2src::SplitString(flag.description, "\n");
 
         ss << descriptions[0];
 
@@ -225,8 +536,8 @@ Options:
             }
         }
 
-        if (!flag.default.empty() && flag.type != CommandLineOption::Type::BOOLEAN) {
-            ss << " [default: \"" << flag.default << "\"]";
+        if (!flag.default_value.empty() && flag.type != CommandLineOption::Type::BOOLEAN) {
+            ss << " [default: \"" << flag.default_value << "\"]";
         }
 
         ss << "\n";
@@ -248,7 +559,7 @@ int main(int argc, const char* argv[]) {
 
     // Populate default args
     for (size_t i = 0; i < (size_t)CommandLineOption::Id::MAX; ++i) {
-        args[i] = command_line_options[i].default;
+        args[i] = command_line_options[i].default_value;
     }
 
     bool print_help = false;
@@ -280,7 +591,7 @@ int main(int argc, const char* argv[]) {
         if (command_line_option->type == CommandLineOption::Type::BOOLEAN) {
             args[static_cast<size_t>(command_line_option->id)] = "1";
         }
-        else if (command_line_option->type == CommandLineOption::Type::STRING) {
+        else {
             // Read ahead
             ++i;
             if (i >= argc - 2) {
@@ -289,7 +600,13 @@ int main(int argc, const char* argv[]) {
             }
 
             std::string val = argv[i];
-            args[(size_t)command_line_option->id] = val;
+            std::string& current_val = args[(size_t)command_line_option->id];
+
+            if (command_line_option->type == CommandLineOption::Type::LIST && !current_val.empty()) {
+                current_val += ";" + val;
+            } else {
+                current_val = val;
+            }
         }
     }
 
@@ -303,185 +620,219 @@ int main(int argc, const char* argv[]) {
         return 1;
     }
 
-    DWORD cwd_length = ::GetCurrentDirectory(0, NULL);
-    std::string cwd(cwd_length, '\0');
-    ::GetCurrentDirectory(cwd_length, cwd.data());
-    cwd.back() = '\\'; // replace null terminator with backslash
-
-    std::string root_input_path  = NormalizeDirectoryString(argv[argc - 2]);
-    std::string root_output_path = NormalizeDirectoryString(argv[argc - 1]);
+    dir2src::Options options;
+    options.root_namespace = args[(size_t)CommandLineOption::Id::ROOT_NAMESPACE];
 
-    std::vector<std::string> root_input_directories = SplitString(root_input_path, "\\");
-    std::vector<std::string> root_output_directories = SplitString(root_output_path, "\\");
+    const std::string& format = args[(size_t)CommandLineOption::Id::FORMAT];
 
-    std::vector<std::string> open_directory_list{ root_input_path };
-
-    std::vector<std::string> header_namespaces;
+    if (format == "array") options.format = dir2src::Format::ARRAY;
+    else if (format == "hex") options.format = dir2src::Format::HEX;
+    else {
+        fprintf(stderr, "Unknown format \"%s\"\n", format.c_str());
+        return 1;
+    }
 
-    std::stringstream ss_header_file;
-    ss_header_file << R"(// AUTOGENERATED
+    const std::string& depfile_path = args[(size_t)CommandLineOption::Id::DEPFILE];
+    const bool restat = args[(size_t)CommandLineOption::Id::RESTAT] == "1";
+    const std::string& stamp_path = args[(size_t)CommandLineOption::Id::STAMP];
 
-#pragma once
+    const std::string& shard = args[(size_t)CommandLineOption::Id::SHARD];
 
-#include <array>
-#include <cstdint>
-
-namespace )";
+    if (!shard.empty() && (sscanf(shard.c_str(), "%zu/%zu", &options.shard_index, &options.shard_count) != 2 ||
+                           options.shard_count == 0 || options.shard_index >= options.shard_count)) {
+        fprintf(stderr, "Invalid shard \"%s\", expected <index>/<count>\n", shard.c_str());
+        return 1;
+    }
 
-    ss_header_file << args[(size_t)CommandLineOption::Id::ROOT_NAMESPACE] << " {\n\n";
+    size_t write_threads = 0;
 
-    while (!open_directory_list.empty()) {
-        std::string dir = NormalizeDirectoryString(open_directory_list.back());
-        open_directory_list.pop_back();
+    for (auto [id, thread_count] : {
+        std::pair{ CommandLineOption::Id::WRITE_THREADS, &write_threads },
+        std::pair{ CommandLineOption::Id::READ_THREADS, &options.read_threads },
+        std::pair{ CommandLineOption::Id::ENCODE_THREADS, &options.encode_threads },
+    }) {
+        const std::string& thread_count_arg = args[(size_t)id];
 
-        std::string search_path = dir;
-        if (search_path.back() != '*') {
-            search_path.push_back('*');
+        if (sscanf(thread_count_arg.c_str(), "%zu", thread_count) != 1) {
+            fprintf(stderr, "Invalid thread count \"%s\"\n", thread_count_arg.c_str());
+            return 1;
         }
+    }
 
-        WIN32_FIND_DATA find_data = {};
-        HANDLE h_find_file = ::FindFirstFile(search_path.c_str(), &find_data);
-
-        while (h_find_file != INVALID_HANDLE_VALUE) {
-
-            if (!strcmp(find_data.cFileName, ".") ||
-                !strcmp(find_data.cFileName, "..")) {
-
-                BOOL found_next_file = ::FindNextFile(h_find_file, &find_data);
-                if (!found_next_file) break;
-                continue;
-            }
-
-            std::string relative_path = dir + find_data.cFileName;
-
-            if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                open_directory_list.push_back(relative_path);
-            }
-            else {
-                
-                std::vector<uint8_t> file_data;
-                ReadFile(relative_path, &file_data);
-
-                std::vector<std::string> directories = SplitString(dir, "\\");
-                std::vector<std::string> output_directories = directories;
-                output_directories.erase(output_directories.begin(), output_directories.begin() + root_input_directories.size());
-
-                std::vector<std::string> namespaces = output_directories;
-
-                output_directories.insert(output_directories.begin(), root_output_directories.begin(), root_output_directories.end());
-
-                for (auto& str : namespaces) {
-                    str = CodeFriendlyString(str);
-                }
+    options.include_patterns = dir2src::SplitString(args[(size_t)CommandLineOption::Id::INCLUDE], ";");
+    options.exclude_patterns = dir2src::SplitString(args[(size_t)CommandLineOption::Id::EXCLUDE], ";");
+    options.ignore_file_name = args[(size_t)CommandLineOption::Id::IGNORE_FILE];
+    options.nul_terminated_patterns = dir2src::SplitString(args[(size_t)CommandLineOption::Id::NUL_TERMINATE], ";");
+    options.compressed_patterns = dir2src::SplitString(args[(size_t)CommandLineOption::Id::COMPRESS], ";");
+    options.generate_index = args[(size_t)CommandLineOption::Id::INDEX] == "1";
+    options.pack = args[(size_t)CommandLineOption::Id::PACK] == "1";
+    options.bulk_fallback = args[(size_t)CommandLineOption::Id::BULK_FALLBACK] == "1";
+    options.pack_runtime_path = args[(size_t)CommandLineOption::Id::PACK_PATH];
+    options.dev_accessors = args[(size_t)CommandLineOption::Id::DEV] == "1";
+    options.header_only = args[(size_t)CommandLineOption::Id::HEADER_ONLY] == "1";
+    options.minify = args[(size_t)CommandLineOption::Id::MINIFY] == "1";
+    options.checksums = args[(size_t)CommandLineOption::Id::CHECKSUM] == "1";
+    options.http_metadata = args[(size_t)CommandLineOption::Id::HTTP_METADATA] == "1";
+    options.instrument = args[(size_t)CommandLineOption::Id::INSTRUMENT] == "1";
+    options.prune_unprofiled = args[(size_t)CommandLineOption::Id::PRUNE_UNPROFILED] == "1";
+    options.plan = args[(size_t)CommandLineOption::Id::PLAN] == "1";
+    options.module_name = args[(size_t)CommandLineOption::Id::MODULE];
+
+    std::string source_date_epoch = args[(size_t)CommandLineOption::Id::SOURCE_DATE_EPOCH];
+
+    if (source_date_epoch.empty()) {
+        char variable[32];
+        const DWORD length = GetEnvironmentVariable("SOURCE_DATE_EPOCH", variable, sizeof(variable));
+
+        if (length > 0 && length < sizeof(variable)) {
+            source_date_epoch.assign(variable, length);
+        }
+    }
 
-                std::string s = dir;
+    if (!source_date_epoch.empty() &&
+        (sscanf(source_date_epoch.c_str(), "%lld", (long long*)&options.source_date_epoch) != 1 || options.source_date_epoch < 0)) {
+        fprintf(stderr, "Invalid source date epoch \"%s\", expected Unix seconds\n", source_date_epoch.c_str());
+        return 1;
+    }
 
-                std::stringstream ss_cpp_file;
-                ss_cpp_file << R"(// AUTOGENERATED
+    const std::string& gzip = args[(size_t)CommandLineOption::Id::GZIP];
 
-#include <array>
-#include <cstdint>
+    if (sscanf(gzip.c_str(), "%u", &options.gzip_max_percent) != 1 || options.gzip_max_percent > 100) {
+        fprintf(stderr, "Invalid gzip percentage \"%s\", expected 0 to 100\n", gzip.c_str());
+        return 1;
+    }
 
-namespace )";
+    for (auto [id, byte_size] : {
+        std::pair{ CommandLineOption::Id::SMALL_FILE_SIZE, &options.small_file_size },
+        std::pair{ CommandLineOption::Id::SMALL_BATCH_SIZE, &options.small_batch_size },
+        std::pair{ CommandLineOption::Id::BULK_FILE_SIZE, &options.bulk_file_size },
+        std::pair{ CommandLineOption::Id::PAGE_ALIGN, &options.page_align_file_size },
+        std::pair{ CommandLineOption::Id::CHUNK_SIZE, &options.compression_chunk_size },
+    }) {
+        const std::string& byte_size_arg = args[(size_t)id];
+
+        if (!ParseByteSize(byte_size_arg, byte_size)) {
+            fprintf(stderr, "Invalid size \"%s\"\n", byte_size_arg.c_str());
+            return 1;
+        }
+    }
 
-                ss_cpp_file << args[(size_t)CommandLineOption::Id::ROOT_NAMESPACE] << " {\n";
+    // Paths given on the command line are used as they are
+    dir2src::DiskFileSource unrooted_source("");
 
-                for (const auto& n : namespaces) {
-                    ss_cpp_file << "namespace " << n << " {\n";
-                }
+    const std::string& layout_profile_path = args[(size_t)CommandLineOption::Id::LAYOUT_PROFILE];
 
-                ss_cpp_file << "\nstd::array<uint8_t, ";
+    // Without a profile every file would be pruned
+    if (options.prune_unprofiled && layout_profile_path.empty()) {
+        fprintf(stderr, "--prune-unprofiled needs --layout-profile\n");
+        return 1;
+    }
 
-                std::string array_name = CodeFriendlyString(find_data.cFileName);
+    if (!layout_profile_path.empty()) {
+        std::vector<uint8_t> layout_profile;
 
-                ss_cpp_file << file_data.size() << "> " << array_name << " = {\n\n";
+        if (!unrooted_source.ReadFile(layout_profile_path, &layout_profile)) {
+            fprintf(stderr, "Failed to read layout profile \"%s\"\n", layout_profile_path.c_str());
+            return 1;
+        }
 
-                constexpr size_t split = 12;
+        std::string_view lines((const char*)layout_profile.data(), layout_profile.size());
 
-                for (size_t i = 0; i < file_data.size(); ++i) {
+        while (!lines.empty()) {
+            size_t line_end = std::min(lines.find('\n'), lines.size());
+            std::string_view line = lines.substr(0, line_end);
+            lines.remove_prefix(std::min(line_end + 1, lines.size()));
 
-                    if (i % split == 0) {
-                        ss_cpp_file << "    ";
-                    }
+            if (line.ends_with('\r')) line.remove_suffix(1);
 
-                    uint8_t c = file_data[i];
+            // Access profiles follow each path with its counts
+            line = line.substr(0, line.find('\t'));
 
-                    if (c < 10) ss_cpp_file << "00";
-                    else if (c < 100) ss_cpp_file << "0";
+            if (!line.empty() && line.front() != '#') {
+                options.layout_profile.emplace_back(line);
+            }
+        }
+    }
 
-                    ss_cpp_file << (int)c;
+    dir2src::DiskFileSource source(argv[argc - 2]);
+    dir2src::DiskOutputSink sink(argv[argc - 1], restat, write_threads);
 
-                    if (i != file_data.size() - 1) {
-                        ss_cpp_file << ",";
+    // Dev builds read the inputs where they are, from any working directory
+    if (options.dev_accessors) {
+        options.dev_source_root = FullPath(source.DiskPath(""));
+        std::replace(options.dev_source_root.begin(), options.dev_source_root.end(), '\\', '/');
 
-                        if ((i + 1) % split == 0) {
-                            ss_cpp_file << "\n";
-                        }
-                        else {
-                            ss_cpp_file << " ";
-                        }
-                    }
-                }
+        while (options.dev_source_root.size() > 1 && options.dev_source_root.back() == '/') {
+            options.dev_source_root.pop_back();
+        }
+    }
 
-                ss_cpp_file << "\n\n};\n\n";
+    dir2src::GenerateResult result;
+    bool success = dir2src::Generate(source, sink, options, &result);
 
-                for (auto it = namespaces.rbegin(); it != namespaces.rend(); ++it) {
-                    ss_cpp_file << "} // end of namespace " << *it << "\n";
-                }
-                ss_cpp_file << "} // end of namespace Bin\n";
+    // Nothing was written, so there's nothing to stamp or depend on
+    if (options.plan) {
+        PrintPlan(result);
+        return success ? 0 : 1;
+    }
 
-                std::string output_data = ss_cpp_file.str();
+    if (args[(size_t)CommandLineOption::Id::PRINT_OUTPUT_FILES] == "1") {
+        for (const auto& output_path : result.output_paths) {
+            // Bulk files also write data for their sources to pull in
+            if (output_path.ends_with(".cpp")) {
+                printf("%s\n", FullPath(sink.DiskPath(output_path)).c_str());
+            }
+        }
+    }
+    else {
+        if (options.minify) {
+            printf("Minified %zu files, saving %llu bytes\n", result.minified_file_count, (unsigned long long)result.minified_bytes_saved);
+        }
 
-                std::string file_output_path = root_output_path + dir;
-                std::vector<std::string> file_output_directory_list = SplitString(file_output_path, "\\");
+        if (options.gzip_max_percent > 0) {
+            printf("Gzipped %zu files, saving %llu bytes\n", result.gzipped_file_count, (unsigned long long)result.gzipped_bytes_saved);
+        }
+    }
 
-                // Create nested output directories
-                std::string current_directory_path;
-                for (const auto& directory : output_directories) {
-                    current_directory_path += directory + "\\";
-                    ::CreateDirectory(current_directory_path.c_str(), NULL);
-                }
+    std::vector<std::string> output_paths;
+    std::vector<std::string> input_paths;
 
-                std::string path = current_directory_path + find_data.cFileName + ".cpp";
-                ::WriteFile(current_directory_path + find_data.cFileName + ".cpp", output_data);
+    for (const auto& output_path : result.output_paths) {
+        output_paths.push_back(sink.DiskPath(output_path));
+    }
 
-                if (args[(size_t)CommandLineOption::Id::PRINT_OUTPUT_FILES] == "1") {
-                    printf("%s%s\n", cwd.c_str(), path.c_str());
-                }
+    for (const auto& input_path : result.input_paths) {
+        input_paths.push_back(source.DiskPath(input_path));
+    }
 
-                // Populate namespaces for header
-                for (size_t i = 0; i < header_namespaces.size(); ++i) {
-                    if (header_namespaces[i] != namespaces[i] || namespaces.size() <= i) {
-                        size_t diff = header_namespaces.size() - namespaces.size() + 1;
+    // A new profile reorders the outputs
+    if (!layout_profile_path.empty()) {
+        input_paths.push_back(layout_profile_path);
+    }
 
-                        for (size_t j = 0; j < diff; ++j) {
-                            ss_header_file << "\n}\n";
-                        }
+    dir2src::DiskOutputSink unrooted_sink("", false);
 
-                        header_namespaces.resize(i);
-                        break;
-                    }
-                }
+    if (!stamp_path.empty()) {
+        success &= unrooted_sink.WriteFile(stamp_path, "");
+        output_paths.insert(output_paths.begin(), stamp_path);
+    }
 
-                for (size_t i = header_namespaces.size(); i < namespaces.size(); ++i) {
-                    header_namespaces.push_back(namespaces[i]);
-                    ss_header_file << "\nnamespace " << namespaces[i] << " {\n\n";
-                }
+    if (!depfile_path.empty()) {
+        std::stringstream ss_depfile;
 
-                ss_header_file << "extern std::array<uint8_t, " << file_data.size() << "> " << array_name << ";\n";
-            }
+        for (size_t i = 0; i < output_paths.size(); ++i) {
+            ss_depfile << DepfilePath(output_paths[i]) << (i + 1 < output_paths.size() ? " \\\n" : ":");
+        }
 
-            BOOL found_next_file = ::FindNextFile(h_find_file, &find_data);
-            if (!found_next_file) break;
+        for (const auto& input_path : input_paths) {
+            ss_depfile << " \\\n  " << DepfilePath(input_path);
         }
-    }
 
-    for (size_t i = 0; i < header_namespaces.size() + 1; ++i) {
-        ss_header_file << "\n}\n";
-    }
+        ss_depfile << "\n";
 
-    std::string header_output_data = ss_header_file.str();
-    ::WriteFile(root_output_path + "bin.h", header_output_data);
+        // Always rewritten: the build system expects it to be fresh after each run
+        success &= unrooted_sink.WriteFile(depfile_path, ss_depfile.str());
+    }
 
-    return 0;
+    return success ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,453 @@
+#include "minify.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace dir2src {
+
+namespace {
+
+bool IsSpace(uint8_t c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::tolower((uint8_t)a[i]) != std::tolower((uint8_t)b[i])) return false;
+    }
+
+    return true;
+}
+
+// Characters that run together into one token when the space between them
+// goes. '.' counts as part of a word so "1 .5" stays apart.
+bool IsWordChar(uint8_t c) {
+    return std::isalnum(c) || c == '_' || c == '.' || c >= 0x80;
+}
+
+bool IsOperatorChar(uint8_t c) {
+    return std::string_view("+-*/%<>=!&|^~?:#").find((char)c) != std::string_view::npos;
+}
+
+// Reads and writes the same buffer, the write position never ahead of the
+// read position. Whitespace is only ever put back in place of text skipped
+// since the last write, which keeps it that way.
+struct InPlaceText {
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t read = 0;
+    size_t write = 0;
+
+    bool AtEnd() const {
+        return read >= size;
+    }
+
+    uint8_t Peek(size_t ahead = 0) const {
+        return read + ahead < size ? data[read + ahead] : 0;
+    }
+
+    uint8_t Last() const {
+        return write > 0 ? data[write - 1] : 0;
+    }
+
+    bool StartsWith(std::string_view str, bool ignore_case = false) const {
+        if (size - read < str.size()) return false;
+
+        for (size_t i = 0; i < str.size(); ++i) {
+            uint8_t c = data[read + i];
+            if (ignore_case) c = (uint8_t)std::tolower(c);
+
+            if (c != (uint8_t)str[i]) return false;
+        }
+
+        return true;
+    }
+
+    void Copy(size_t count = 1) {
+        for (; count > 0 && read < size; --count) {
+            data[write++] = data[read++];
+        }
+    }
+
+    void Skip(size_t count = 1) {
+        read = std::min(read + count, size);
+    }
+
+    void Put(uint8_t c) {
+        data[write++] = c;
+    }
+
+    // Up to `terminator`, or the end
+    void CopyUntil(std::string_view terminator, bool ignore_case = false) {
+        while (!AtEnd() && !StartsWith(terminator, ignore_case)) Copy();
+    }
+
+    void CopyPast(std::string_view terminator) {
+        CopyUntil(terminator);
+        Copy(terminator.size());
+    }
+
+    void SkipPast(std::string_view terminator) {
+        while (!AtEnd() && !StartsWith(terminator)) Skip();
+        Skip(terminator.size());
+    }
+
+    // From the opening quote at the read position through the closing one
+    void CopyQuoted(bool escapes) {
+        const uint8_t quote = Peek();
+        Copy();
+
+        while (!AtEnd()) {
+            if (escapes && Peek() == '\\') {
+                Copy(2);
+            }
+            else if (Peek() == quote) {
+                Copy();
+                return;
+            }
+            else {
+                Copy();
+            }
+        }
+    }
+};
+
+void MinifyJson(InPlaceText& text) {
+    while (!text.AtEnd()) {
+        const uint8_t c = text.Peek();
+
+        if (c == '"') {
+            text.CopyQuoted(true);
+        }
+        else if (IsSpace(c)) {
+            text.Skip();
+        }
+        else if (text.StartsWith("//")) {
+            text.SkipPast("\n");
+        }
+        else if (text.StartsWith("/*")) {
+            text.SkipPast("*/");
+        }
+        else {
+            text.Copy();
+        }
+    }
+}
+
+// C-like: comments go, whitespace goes wherever tokens can't run together,
+// and each preprocessor directive keeps its own line and its spaces
+void MinifyShader(InPlaceText& text) {
+    bool line_start = true;
+    bool in_directive = false;
+    bool skipped_space = false;
+
+    while (!text.AtEnd()) {
+        const uint8_t c = text.Peek();
+
+        // Line splices join lines before anything else sees them
+        if (c == '\\' && (text.Peek(1) == '\n' || (text.Peek(1) == '\r' && text.Peek(2) == '\n'))) {
+            text.Skip(text.Peek(1) == '\r' ? 3 : 2);
+            continue;
+        }
+
+        if (c == '\n') {
+            text.Skip();
+
+            if (in_directive) {
+                text.Put('\n');
+                in_directive = false;
+                skipped_space = false;
+            }
+            else {
+                skipped_space = true;
+            }
+
+            line_start = true;
+            continue;
+        }
+
+        if (IsSpace(c)) {
+            text.Skip();
+            skipped_space = true;
+            continue;
+        }
+
+        // Stops short of the newline, which may end a directive
+        if (text.StartsWith("//")) {
+            while (!text.AtEnd() && text.Peek() != '\n') text.Skip();
+            continue;
+        }
+
+        if (text.StartsWith("/*")) {
+            text.SkipPast("*/");
+            skipped_space = true;
+            continue;
+        }
+
+        if (line_start && c == '#') {
+            if (text.write > 0 && text.Last() != '\n') text.Put('\n');
+            in_directive = true;
+        }
+        else if (skipped_space && text.write > 0) {
+            const uint8_t last = text.Last();
+
+            // "#define F (x)" isn't "#define F(x)"
+            if ((in_directive && last != '\n') ||
+                (IsWordChar(last) && IsWordChar(c)) ||
+                (IsOperatorChar(last) && IsOperatorChar(c))) {
+                text.Put(' ');
+            }
+        }
+
+        line_start = false;
+        skipped_space = false;
+
+        if (c == '"' || c == '\'') {
+            text.CopyQuoted(true);
+        }
+        else {
+            text.Copy();
+        }
+    }
+}
+
+// Only punctuation that never changes meaning with a space around it. A
+// space before ':' is a descendant selector, and calc() needs its spaces.
+bool IsCssPunctuation(uint8_t c) {
+    return c == '{' || c == '}' || c == ';' || c == ',' || c == '>';
+}
+
+void MinifyCss(InPlaceText& text) {
+    bool skipped_space = false;
+
+    while (!text.AtEnd()) {
+        const uint8_t c = text.Peek();
+
+        if (IsSpace(c)) {
+            text.Skip();
+            skipped_space = true;
+            continue;
+        }
+
+        if (text.StartsWith("/*")) {
+            text.SkipPast("*/");
+            skipped_space = true;
+            continue;
+        }
+
+        if (skipped_space && text.write > 0) {
+            const uint8_t last = text.Last();
+
+            if (!IsCssPunctuation(last) && last != ':' && !IsCssPunctuation(c)) {
+                text.Put(' ');
+            }
+        }
+
+        skipped_space = false;
+
+        if (c == '"' || c == '\'') {
+            text.CopyQuoted(true);
+        }
+        else {
+            text.Copy();
+        }
+    }
+}
+
+// Elements whose text is taken as it is. SVG collapses whitespace in
+// every other element.
+constexpr struct {
+    std::string_view name;
+    std::string_view end_tag;
+    bool in_svg;
+} raw_text_elements[] = {
+    { "script", "</script", true },
+    { "style", "</style", true },
+    { "pre", "</pre", false },
+    { "textarea", "</textarea", false },
+};
+
+// SVG elements whose whitespace is rendered, collapsed, even when it's
+// only indentation between their child tags
+constexpr std::string_view svg_text_elements[] = { "text", "tspan", "textPath" };
+
+bool IsSvgTextElement(std::string_view name) {
+    for (const auto& element : svg_text_elements) {
+        if (EqualsIgnoreCase(name, element)) return true;
+    }
+    return false;
+}
+
+// Whitespace in text collapses to one space, as both HTML and SVG render
+// it. Whitespace-only runs with a line break between SVG tags are only
+// indentation and go entirely, outside text content elements.
+void MinifyMarkup(InPlaceText& text, bool svg) {
+    size_t text_depth = 0;
+
+    while (!text.AtEnd()) {
+        const uint8_t c = text.Peek();
+
+        if (text.StartsWith("<!--")) {
+            // Conditional comments are read by old browsers
+            if (text.StartsWith("<!--[")) {
+                text.CopyPast("-->");
+            }
+            else {
+                text.SkipPast("-->");
+            }
+            continue;
+        }
+
+        if (text.StartsWith("<![CDATA[")) {
+            text.CopyPast("]]>");
+            continue;
+        }
+
+        if (IsSpace(c)) {
+            bool line_break = false;
+
+            while (!text.AtEnd() && IsSpace(text.Peek())) {
+                line_break |= text.Peek() == '\n';
+                text.Skip();
+            }
+
+            const bool between_tags = text.Last() == '>' && text.Peek() == '<';
+
+            // A dropped comment may have had space on both sides
+            if (text.write > 0 && !text.AtEnd() && text.Last() != ' ' && !(svg && text_depth == 0 && between_tags && line_break)) {
+                text.Put(' ');
+            }
+            continue;
+        }
+
+        const uint8_t next = text.Peek(1);
+
+        if (c != '<' || !(std::isalpha(next) || next == '/' || next == '!' || next == '?')) {
+            text.Copy();
+            continue;
+        }
+
+        // A tag: attribute values are kept, the whitespace between them
+        // collapses and goes entirely around '=' and before '>'
+        text.Copy();
+
+        const bool closing = text.Peek() == '/';
+        const size_t name_start = text.write + closing;
+
+        while (!text.AtEnd() && text.Peek() != '>' && !IsSpace(text.Peek())) {
+            if (text.Peek() == '"' || text.Peek() == '\'') {
+                text.CopyQuoted(false);
+            }
+            else {
+                text.Copy();
+            }
+        }
+
+        const std::string_view name((const char*)text.data + name_start, text.write - std::min(name_start, text.write));
+
+        while (!text.AtEnd() && text.Peek() != '>') {
+            const uint8_t tag_c = text.Peek();
+
+            if (IsSpace(tag_c)) {
+                while (!text.AtEnd() && IsSpace(text.Peek())) text.Skip();
+
+                const uint8_t last = text.Last();
+                const uint8_t following = text.Peek();
+
+                // An unquoted value would take a '/' as its own
+                const bool before_end = following == '>' ||
+                    (following == '/' && text.Peek(1) == '>' && (last == '"' || last == '\''));
+
+                if (!before_end && last != '=' && following != '=') {
+                    text.Put(' ');
+                }
+            }
+            else if (tag_c == '"' || tag_c == '\'') {
+                text.CopyQuoted(false);
+            }
+            else {
+                text.Copy();
+            }
+        }
+
+        const bool self_closing = text.Last() == '/';
+        text.Copy();
+
+        if (svg && !self_closing && IsSvgTextElement(name)) {
+            if (!closing) {
+                ++text_depth;
+            }
+            else if (text_depth > 0) {
+                --text_depth;
+            }
+        }
+
+        if (closing || self_closing) {
+            continue;
+        }
+
+        for (const auto& element : raw_text_elements) {
+            if ((!svg || element.in_svg) && EqualsIgnoreCase(name, element.name)) {
+                text.CopyUntil(element.end_tag, true);
+                break;
+            }
+        }
+    }
+}
+
+} // namespace
+
+MinifyLanguage MinifyLanguageOf(std::string_view path) {
+    const size_t dot_idx = path.rfind('.');
+    if (dot_idx == std::string_view::npos || path.find('/', dot_idx) != std::string_view::npos) {
+        return MinifyLanguage::NONE;
+    }
+
+    const std::string_view extension = path.substr(dot_idx + 1);
+
+    constexpr struct {
+        std::string_view extension;
+        MinifyLanguage language;
+    } extension_languages[] = {
+        { "json", MinifyLanguage::JSON },
+        { "glsl", MinifyLanguage::SHADER },
+        { "vert", MinifyLanguage::SHADER },
+        { "frag", MinifyLanguage::SHADER },
+        { "geom", MinifyLanguage::SHADER },
+        { "comp", MinifyLanguage::SHADER },
+        { "tesc", MinifyLanguage::SHADER },
+        { "tese", MinifyLanguage::SHADER },
+        { "hlsl", MinifyLanguage::SHADER },
+        { "hlsli", MinifyLanguage::SHADER },
+        { "fx", MinifyLanguage::SHADER },
+        { "css", MinifyLanguage::CSS },
+        { "svg", MinifyLanguage::SVG },
+        { "html", MinifyLanguage::HTML },
+        { "htm", MinifyLanguage::HTML },
+    };
+
+    for (const auto& entry : extension_languages) {
+        if (EqualsIgnoreCase(extension, entry.extension)) return entry.language;
+    }
+
+    return MinifyLanguage::NONE;
+}
+
+void Minify(MinifyLanguage language, std::vector<uint8_t>* data) {
+    InPlaceText text{ data->data(), data->size() };
+
+    switch (language) {
+    case MinifyLanguage::NONE: return;
+    case MinifyLanguage::JSON: MinifyJson(text); break;
+    case MinifyLanguage::SHADER: MinifyShader(text); break;
+    case MinifyLanguage::CSS: MinifyCss(text); break;
+    case MinifyLanguage::SVG: MinifyMarkup(text, true); break;
+    case MinifyLanguage::HTML: MinifyMarkup(text, false); break;
+    }
+
+    data->resize(text.write);
+}
+
+} // namespace dir2src
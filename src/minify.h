@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace dir2src {
+
+// Text formats whose comments and insignificant whitespace can be stripped
+// without changing what their consumer makes of them
+enum class MinifyLanguage {
+    NONE,
+    JSON,   // also strips // and /* */ comments, as JSONC allows
+    SHADER, // GLSL and HLSL; preprocessor lines are kept intact
+    CSS,
+    SVG,
+    HTML,   // <pre>, <textarea>, <script> and <style> are left alone
+};
+
+// Picked by file extension, ignoring case
+MinifyLanguage MinifyLanguageOf(std::string_view path);
+
+// Minifies in place. Text only ever shrinks, so nothing is allocated.
+// Lines aren't kept, so shader diagnostics point at the minified source.
+void Minify(MinifyLanguage language, std::vector<uint8_t>* data);
+
+} // namespace dir2src
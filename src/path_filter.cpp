@@ -0,0 +1,222 @@
+#include "path_filter.h"
+
+namespace dir2src {
+
+namespace {
+
+// Matches one character against the class starting after the '[' at
+// glob[0], returning the length of the class including its ']', or 0 if the
+// class isn't terminated and the '[' should be taken literally
+size_t MatchCharacterClass(std::string_view glob, char c, bool* matched) {
+    size_t i = 0;
+
+    const bool negate = i < glob.size() && (glob[i] == '!' || glob[i] == '^');
+    if (negate) ++i;
+
+    bool found = false;
+
+    // A ']' straight after the opening bracket is part of the class
+    for (size_t first = i; i < glob.size() && (glob[i] != ']' || i == first); ++i) {
+        char low = glob[i];
+        char high = low;
+
+        if (i + 2 < glob.size() && glob[i + 1] == '-' && glob[i + 2] != ']') {
+            high = glob[i + 2];
+            i += 2;
+        }
+
+        found |= low <= c && c <= high;
+    }
+
+    if (i >= glob.size()) {
+        return 0;
+    }
+
+    *matched = c != '/' && found != negate;
+    return i + 1;
+}
+
+bool HasWildcards(std::string_view pattern) {
+    return pattern.find_first_of("*?[\\") != std::string_view::npos;
+}
+
+std::string_view NameOf(std::string_view path) {
+    size_t separator_idx = path.rfind('/');
+    return separator_idx == std::string_view::npos ? path : path.substr(separator_idx + 1);
+}
+
+} // namespace
+
+bool PathFilter::GlobMatch(std::string_view glob, std::string_view str) {
+    size_t gi = 0;
+    size_t si = 0;
+
+    while (gi < glob.size()) {
+        const char g = glob[gi];
+
+        if (g == '*') {
+            if (gi + 1 < glob.size() && glob[gi + 1] == '*') {
+                std::string_view rest = glob.substr(gi + 2);
+
+                // "**/" also matches no directories at all
+                if (!rest.empty() && rest.front() == '/') {
+                    rest.remove_prefix(1);
+
+                    for (size_t i = si; i <= str.size(); ++i) {
+                        if ((i == si || str[i - 1] == '/') && GlobMatch(rest, str.substr(i))) {
+                            return true;
+                        }
+                    }
+
+                    return false;
+                }
+
+                for (size_t i = si; i <= str.size(); ++i) {
+                    if (GlobMatch(rest, str.substr(i))) return true;
+                }
+
+                return false;
+            }
+
+            std::string_view rest = glob.substr(gi + 1);
+
+            for (size_t i = si; i <= str.size(); ++i) {
+                if (GlobMatch(rest, str.substr(i))) return true;
+                if (i < str.size() && str[i] == '/') break;
+            }
+
+            return false;
+        }
+
+        if (si >= str.size()) {
+            return false;
+        }
+
+        const char c = str[si];
+
+        if (g == '?') {
+            if (c == '/') return false;
+        }
+        else if (g == '[') {
+            bool matched = false;
+            size_t class_length = MatchCharacterClass(glob.substr(gi + 1), c, &matched);
+
+            if (class_length > 0) {
+                if (!matched) return false;
+
+                gi += 1 + class_length;
+                ++si;
+                continue;
+            }
+
+            if (c != '[') return false;
+        }
+        else if (g == '\\' && gi + 1 < glob.size()) {
+            if (c != glob[++gi]) return false;
+        }
+        else if (c != g) {
+            return false;
+        }
+
+        ++gi;
+        ++si;
+    }
+
+    return si == str.size();
+}
+
+bool PathFilter::PatternSet::empty() const {
+    return names.empty() && directory_names.empty() && name_suffixes.empty() && name_globs.empty() && path_globs.empty();
+}
+
+void PathFilter::PatternSet::Add(std::string_view pattern) {
+    while (!pattern.empty() && (pattern.back() == ' ' || pattern.back() == '\t' || pattern.back() == '\r')) {
+        pattern.remove_suffix(1);
+    }
+
+    const bool directory_only = !pattern.empty() && pattern.back() == '/';
+
+    while (!pattern.empty() && pattern.back() == '/') {
+        pattern.remove_suffix(1);
+    }
+
+    if (pattern.empty()) {
+        return;
+    }
+
+    // Any other '/' anchors the pattern to the root
+    if (pattern.find('/') != std::string_view::npos) {
+        if (pattern.front() == '/') pattern.remove_prefix(1);
+
+        path_globs.push_back({ std::string(pattern), directory_only });
+        return;
+    }
+
+    if (!HasWildcards(pattern)) {
+        (directory_only ? directory_names : names).emplace(pattern);
+    }
+    else if (pattern.front() == '*' && !HasWildcards(pattern.substr(1))) {
+        name_suffixes.push_back({ std::string(pattern.substr(1)), directory_only });
+    }
+    else {
+        name_globs.push_back({ std::string(pattern), directory_only });
+    }
+}
+
+bool PathFilter::PatternSet::Matches(std::string_view path, bool is_directory) const {
+    std::string_view name = NameOf(path);
+
+    if (names.contains(name) || (is_directory && directory_names.contains(name))) {
+        return true;
+    }
+
+    for (const auto& suffix : name_suffixes) {
+        if ((is_directory || !suffix.directory_only) && name.ends_with(suffix.pattern)) return true;
+    }
+
+    for (const auto& glob : name_globs) {
+        if ((is_directory || !glob.directory_only) && GlobMatch(glob.pattern, name)) return true;
+    }
+
+    for (const auto& glob : path_globs) {
+        if ((is_directory || !glob.directory_only) && GlobMatch(glob.pattern, path)) return true;
+    }
+
+    return false;
+}
+
+void PathFilter::PatternList::Add(std::string_view pattern) {
+    const bool negated = !pattern.empty() && pattern.front() == '!';
+    if (negated) pattern.remove_prefix(1);
+
+    if (runs.empty() || runs.back().negated != negated) {
+        runs.push_back({ {}, negated });
+    }
+
+    runs.back().patterns.Add(pattern);
+}
+
+bool PathFilter::PatternList::Matches(std::string_view path, bool is_directory) const {
+    for (auto run = runs.rbegin(); run != runs.rend(); ++run) {
+        if (run->patterns.Matches(path, is_directory)) return !run->negated;
+    }
+    return false;
+}
+
+void PathFilter::AddInclude(std::string_view pattern) {
+    includes.Add(pattern);
+}
+
+void PathFilter::AddExclude(std::string_view pattern) {
+    excludes.Add(pattern);
+}
+
+bool PathFilter::IsExcluded(std::string_view path, bool is_directory) const {
+    return excludes.Matches(path, is_directory);
+}
+
+bool PathFilter::IsIncluded(std::string_view path, bool is_directory) const {
+    return includes.empty() || includes.Matches(path, is_directory);
+}
+
+} // namespace dir2src
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace dir2src {
+
+// Include and exclude globs, matched against root-relative paths while the
+// tree is walked so excluded directories are never listed.
+//
+// Patterns follow .gitignore: `*` and `?` stop at '/', `**` crosses it, and
+// `[...]` matches a character class. A pattern without a '/' matches the
+// name at any depth, otherwise it's anchored to the root. A trailing '/'
+// only matches directories.
+//
+// An exclude starting with '!' brings back what earlier excludes matched,
+// the last exclude matching a path deciding; "\!" is a literal '!'. As in
+// git, nothing under an excluded directory comes back, as it's never
+// listed. Includes have no negation and take a leading '!' literally.
+//
+// Patterns are sorted by shape when added: plain names become hash lookups
+// and `*<suffix>` patterns suffix compares, so common rules like `.git` or
+// `*.psd` never run the general matcher.
+class PathFilter {
+public:
+    void AddInclude(std::string_view pattern);
+    void AddExclude(std::string_view pattern);
+
+    bool HasIncludes() const { return !includes.empty(); }
+
+    bool IsExcluded(std::string_view path, bool is_directory) const;
+    bool IsIncluded(std::string_view path, bool is_directory) const;
+
+    // Matches the glob against the whole of `str`
+    static bool GlobMatch(std::string_view glob, std::string_view str);
+
+private:
+    struct Glob {
+        std::string pattern;
+        bool directory_only = false;
+    };
+
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+    };
+
+    using NameSet = std::unordered_set<std::string, StringHash, std::equal_to<>>;
+
+    struct PatternSet {
+        NameSet names;
+        NameSet directory_names;
+        std::vector<Glob> name_suffixes;
+        std::vector<Glob> name_globs;
+        std::vector<Glob> path_globs;
+
+        bool empty() const;
+        void Add(std::string_view pattern);
+        bool Matches(std::string_view path, bool is_directory) const;
+    };
+
+    // Excludes in the order added, each run of negated or plain ones
+    // sharing a set
+    struct PatternList {
+        struct Run {
+            PatternSet patterns;
+            bool negated = false;
+        };
+
+        std::vector<Run> runs;
+
+        void Add(std::string_view pattern);
+        bool Matches(std::string_view path, bool is_directory) const;
+    };
+
+    PatternSet includes;
+    PatternList excludes;
+};
+
+} // namespace dir2src